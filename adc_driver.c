@@ -7,6 +7,57 @@
  *              and configure a timer to continually check ADC and sample the
  *              channels sequentially.
  *
+ *              Two acquisition modes are available. In ADC_MODE_SINGLE, Timer0 CCR1
+ *              selects each channel, waits for it to settle and starts one conversion.
+ *              In ADC_MODE_SEQUENCE, Timer0 CCR1 starts a sequence-of-channels
+ *              conversion from A11 down, clocked from SMCLK. The conversions run
+ *              back to back and the ADC interrupt stores each result. The sequence is
+ *              stopped once A8 (CAP) is converted, since A7 and below are unused.
+ *
+ *              In both modes FWD and REF are converted back to back and published
+ *              together as one swr_pair_t, so a reflection coefficient is never
+ *              computed from readings taken at different instants.
+ *
+ *              Every channel passes through an oversampling filter before it is
+ *              published. The filter either accumulates 2^shift conversions and dumps
+ *              their sum (CIC), or keeps a moving sum over the last 2^shift conversions.
+ *              Outputs are scaled to 16 bits, so averaging 4^n conversions gains n
+ *              effective bits. Position channels are reduced back to 12 bits to keep
+ *              the motor limits unchanged. Each update is a constant number of adds.
+ *
+ *              Besides the latest pair, every published pair is also pushed with its
+ *              timestamp into a single producer, single consumer ring. The ADC
+ *              interrupt only advances the head and the consumer only advances the
+ *              tail, so neither side disables interrupts. Records the consumer has not
+ *              released are never overwritten; a pair arriving on a full ring is
+ *              dropped and counted in adc_ring_overruns. update_swr() is the one
+ *              consumer. While a tune or the motors are running it is not called,
+ *              so B2 releases the ring with adc_ring_discard() instead, and the ring
+ *              never fills with readings nobody will use.
+ *
+ *              In sequence mode, each sequence converts one segment of the channels,
+ *              chosen from a four slot schedule picked by the system state. While a
+ *              motor moves, three of four sequences convert only its pot. While a tune
+ *              is probing with carrier present, three of four convert only FWD/REF.
+ *              Every cycle keeps one full sequence so no channel goes stale. A single
+ *              channel segment is followed by the short ADC_SEQ_REPEAT_TICKS gap, so
+ *              a moving motor's pot is converted 2.2 times as often as in full
+ *              sequences. Without the short gap, the fixed gap held that to 1.4x.
+ *
+ *              The window comparator guards FWD and REF. Its interrupts are enabled
+ *              only while those channels convert, since the pots use the full range.
+ *              A conversion above ADC_HI_LIMIT backs off the digipot from the
+ *              interrupt. A FWD conversion below ADC_LO_LIMIT flags ADC_UNDER_RANGE
+ *              for update_digipot() and stays masked until the flag is handled. REF
+ *              is only checked against the upper limit, it is normally far below FWD.
+ *
+ *              Each pair records the AGC gain epoch it started in. A pair that spans
+ *              a gain change is dropped and the FWD/REF filters restart, so every
+ *              published reflection coefficient comes from a single gain setting.
+ *
+ *              Timer0 runs from SMCLK / 8. Its overflow count extends it to 32 bits for
+ *              the frequency counter, which timestamps input edges against it.
+ *
  ******************************************************************************/
 #include "intellitune.h"
 
@@ -14,16 +65,41 @@
 // Function Prototypes
 void initialize_adc(void);
 void current_setting(void);
+void set_adc_mode(uint8_t mode);
+void get_swr_pair(uint8_t reflection_to_calc, swr_pair_t *pair);
+void set_adc_filter(uint8_t type, uint8_t shift);
+uint8_t adc_ring_count(void);
+uint8_t adc_ring_peek(uint8_t index, adc_record_t *record);
+uint8_t adc_ring_read(adc_record_t *record);
+void adc_ring_discard(void);
 
 
 // Globals
 uint8_t adc_channel_select = FWD_PIN;
+uint8_t adc_mode = ADC_MODE_SEQUENCE;
+uint8_t seq_known_switched = 0; // IMP_SWITCH latched when the FWD/REF pair starts
+uint8_t seq_last_channel = CAP_PIN; // Last channel of the running sequence
+uint8_t adc_sched_slot = 0;
+uint16_t seq_gap_ticks = ADC_SEQ_INTERVAL_TICKS; // Delay after the running sequence
+// First and last channel of each sequence segment
+static const uint8_t seg_first[5] = { REF_PIN, REF_PIN, IND_PIN, IND_PIN, CAP_PIN };
+static const uint8_t seg_last[5]  = { CAP_PIN, FWD_PIN, CAP_PIN, IND_PIN, CAP_PIN };
 uint16_t cap_sample = 0;
 uint16_t ind_sample = 0;
-uint16_t fwd_sample = 0;
-uint16_t ref_sample = 0;
-uint16_t fwd_25_sample = 0;
-uint16_t ref_25_sample = 0;
+uint8_t adc_filter_type = ADC_FILTER_CIC;
+uint8_t adc_filter_shift = 2; // Oversampling ratio of 4, one extra bit
+adc_filter_t fwd_filter, ref_filter, ind_filter, cap_filter;
+uint8_t filter_known_switched = 0; // Impedance setting the FWD/REF filters hold samples for
+uint8_t seq_gain_epoch = 0; // AGC gain epoch latched when the FWD/REF pair starts
+uint8_t filter_gain_epoch = 0; // AGC gain epoch the FWD/REF filters hold samples for
+swr_pair_t pending_pair; // FWD/REF pair being converted
+volatile swr_pair_t swr_pair = {0}; // Latest pair with the known impedance switched out
+volatile swr_pair_t swr_known_pair = {0}; // Latest pair with the known impedance switched in
+volatile adc_record_t adc_ring[ADC_RING_SIZE];
+volatile uint8_t adc_ring_head = 0; // Next slot to fill, written only by the ADC interrupt
+volatile uint8_t adc_ring_tail = 0; // Oldest unread record, written only by the consumer
+uint16_t adc_ring_overruns = 0; // Pairs dropped because the ring was full
+volatile uint16_t timer0_overflows = 0; // Upper word of the Timer0 time base used by the frequency counter
 
 
 // TODO: Initialize ADC module
@@ -36,23 +112,272 @@ void initialize_adc(void)
 
     // Configure ADC
     ADCCTL0 &= ~ADCENC; // Disable ADC
-    ADCCTL0 |= ADCSHT_8 | ADCON; // 16ADCclks, MSC, ADC ON
-    ADCCTL1 |= ADCSHP; // s/w trig, single ch/conv, MODOSC
+    ADCCTL0 |= ADCON; // ADC ON, sample time is set with the mode
+    ADCCTL1 |= ADCSHP; // s/w trig
     ADCCTL2 &= ~ADCRES; // clear ADCRES in ADCCTL
     ADCCTL2 |= ADCRES_2; // 12-bit conversion results
     ADCMCTL0 |= ADCSREF_1; // Vref=1.5V
     ADCIE |= ADCIE0; // Enable ADC conv complete interrupt
+    ADCHI = ADC_HI_LIMIT; // Window comparator limits for FWD/REF
+    ADCLO = ADC_LO_LIMIT;
 
     // Configure reference
     PMMCTL0_H = PMMPW_H;                                        // Unlock the PMM registers
     PMMCTL2 |= INTREFEN | REFVSEL_0;                            // Enable internal 1.5V reference
     while(!(PMMCTL2 & REFGENRDY));                            // Poll till internal reference settles
 
-    adc_flg |= ADC_STATUS;
+    set_adc_mode(adc_mode);
     TB0R = 0;
-    TB0CCR1  = 64; // First interrupt will start the first sample and conversion
+    TB0CCR1  = ADC_START_TICKS; // First interrupt will start the first sample and conversion
     TB0CCTL1 = CCIE; // Compare interrupt enable
-    TB0CTL   = (CNTL_0 | TBSSEL_1 | MC__CONTINUOUS); // ACLK as clock source, continuous mode
+    TB0CTL   = (CNTL_0 | TBSSEL_2 | ID_3 | MC__CONTINUOUS | TBIE); // SMCLK / 8 as clock source, continuous mode
+}
+
+
+// Select the acquisition mode. Takes effect from the next Timer0 CCR1 interrupt.
+void set_adc_mode(uint8_t mode)
+{
+    ADCCTL0 &= ~ADCENC;
+    ADCCTL1 &= ~ADCCONSEQ;
+    ADCCTL0 &= ~ADCSHT & ~ADCMSC;
+    ADCCTL1 &= ~ADCSSEL & ~ADCDIV;
+    if(mode == ADC_MODE_SEQUENCE)
+    {
+        ADCCTL0 |= ADC_SEQ_SHT | ADCMSC; // Convert the channels back to back
+        ADCCTL1 |= ADCSSEL_2 | ADCDIV_4; // SMCLK / 5 = 4.8 MHz
+    } else {
+        ADCCTL0 |= ADCSHT_8; // 256 ADCclks
+        // MODOSC, single ch/conv
+    }
+    adc_mode = mode;
+    adc_channel_select = FWD_PIN;
+    adc_flg |= ADC_STATUS;
+}
+
+
+// Set the window comparator interrupts (ADCHIIE, ADCLOIE) for the conversion
+// that follows. Results from before arming are ignored, and the under range
+// interrupt stays masked while a previous one is pending.
+inline void arm_adc_window(uint16_t enable)
+{
+    ADCIFG &= ~ADCHIIFG & ~ADCLOIFG;
+    if(adc_flg & ADC_UNDER_RANGE) { enable &= ~ADCLOIE; }
+    ADCIE = (ADCIE & ~ADCHIIE & ~ADCLOIE) | enable;
+}
+
+
+// Pick the segment for the next sequence and return its first channel. Slot 0
+// of each cycle always converts every channel, the other slots favour what the
+// current state depends on.
+uint8_t next_adc_segment(void)
+{
+    uint8_t segment = ADC_SEG_ALL;
+    uint8_t moving = task_flag & (CAP_MOTOR_ACTIVE | IND_MOTOR_ACTIVE);
+
+    if(adc_sched_slot != 0)
+    {
+        if(moving == (CAP_MOTOR_ACTIVE | IND_MOTOR_ACTIVE)) { segment = ADC_SEG_POTS; }
+        else if(moving == CAP_MOTOR_ACTIVE) { segment = ADC_SEG_CAP; }
+        else if(moving == IND_MOTOR_ACTIVE) { segment = ADC_SEG_IND; }
+        else if(!(task_flag & RF_PRESENT)) { segment = ADC_SEG_POTS; } // FWD only in slot 0 to catch a carrier
+        else if(button_press & TUNE) { segment = ADC_SEG_SWR; }
+    }
+    adc_sched_slot = (adc_sched_slot + 1) & (ADC_SCHED_SLOTS - 1);
+    seq_last_channel = seg_last[segment];
+    seq_gap_ticks = (seg_first[segment] == seg_last[segment]) ? ADC_SEQ_REPEAT_TICKS : ADC_SEQ_INTERVAL_TICKS;
+    return seg_first[segment];
+}
+
+
+// Start one sequence of channels, from the first channel of the scheduled
+// segment down to its last.
+inline void start_adc_sequence(void)
+{
+    seq_known_switched = adc_flg & IMP_SWITCH; // Hold the FWD/REF destination for the whole sequence
+    adc_channel_select = next_adc_segment();
+    seq_gain_epoch = agc_epoch;
+    arm_adc_window((adc_channel_select == REF_PIN) ? ADCHIIE : 0);
+    ADCCTL0 &= ~ADCENC;
+    ADCMCTL0 &= ~ADCINCH;
+    ADCMCTL0 |= adc_channel_select;
+    ADCCTL1 |= ADCCONSEQ_1;
+    adc_flg &= ~ADC_STATUS;
+    ADCCTL0 |= ADCENC | ADCSC;
+}
+
+
+// Clear a filter so its next output only covers new conversions.
+inline void reset_adc_filter(adc_filter_t *filter)
+{
+    filter->sum = 0;
+    filter->index = 0;
+    filter->count = 0;
+}
+
+
+// Add one conversion to a filter. Returns 1 and writes the output, scaled to
+// ADC_HIRES, once the filter has a full window of conversions.
+inline uint8_t update_adc_filter(adc_filter_t *filter, uint16_t adc_reading, uint16_t *output)
+{
+    uint8_t length = 1 << adc_filter_shift;
+
+    switch(adc_filter_type)
+    {
+    case ADC_FILTER_CIC:
+        filter->sum += adc_reading;
+        if(++filter->count < length) { return 0; }
+        *output = (uint16_t)(filter->sum << (ADC_FILTER_MAX_SHIFT - adc_filter_shift));
+        filter->sum = 0;
+        filter->count = 0;
+        return 1;
+
+    case ADC_FILTER_MA:
+        if(filter->count < length) { filter->count++; }
+        else { filter->sum -= filter->window[filter->index]; }
+        filter->sum += adc_reading;
+        filter->window[filter->index] = adc_reading;
+        filter->index = (filter->index + 1) & (length - 1);
+        if(filter->count < length) { return 0; }
+        *output = (uint16_t)(filter->sum << (ADC_FILTER_MAX_SHIFT - adc_filter_shift));
+        return 1;
+
+    default:
+        *output = ADC_HIRES(adc_reading);
+        return 1;
+    }
+}
+
+
+// Select the filter response and oversampling ratio (2^shift) for all channels.
+void set_adc_filter(uint8_t type, uint8_t shift)
+{
+    if(shift > ADC_FILTER_MAX_SHIFT) { shift = ADC_FILTER_MAX_SHIFT; }
+    __bic_SR_register(GIE); // The ADC interrupt updates the filters
+    adc_filter_type = type;
+    adc_filter_shift = shift;
+    reset_adc_filter(&fwd_filter);
+    reset_adc_filter(&ref_filter);
+    reset_adc_filter(&ind_filter);
+    reset_adc_filter(&cap_filter);
+    __bis_SR_register(GIE);
+}
+
+
+// Append a pair record to the ring from the ADC interrupt. The record is written
+// before the head moves, so the consumer never sees a partial record.
+inline void push_adc_record(uint16_t timestamp, uint16_t fwd, uint16_t ref)
+{
+    uint8_t head = adc_ring_head;
+    uint8_t next = (head + 1) & (ADC_RING_SIZE - 1);
+
+    if(next == adc_ring_tail) { adc_ring_overruns++; return; }
+    adc_ring[head].timestamp = timestamp;
+    adc_ring[head].fwd = fwd;
+    adc_ring[head].ref = ref;
+    adc_ring[head].known_switched = seq_known_switched;
+    adc_ring[head].gain_epoch = seq_gain_epoch;
+    adc_ring[head].gain_code = wiper_code;
+    adc_ring_head = next;
+}
+
+
+// Return the number of unread records in the ring.
+uint8_t adc_ring_count(void)
+{
+    return (adc_ring_head - adc_ring_tail) & (ADC_RING_SIZE - 1);
+}
+
+
+// Copy the unread record at the given position, 0 being the oldest, without
+// releasing it. Returns 0 if there is no such record.
+uint8_t adc_ring_peek(uint8_t index, adc_record_t *record)
+{
+    uint8_t slot;
+
+    if(index >= adc_ring_count()) { return 0; }
+    slot = (adc_ring_tail + index) & (ADC_RING_SIZE - 1);
+    record->timestamp = adc_ring[slot].timestamp;
+    record->fwd = adc_ring[slot].fwd;
+    record->ref = adc_ring[slot].ref;
+    record->known_switched = adc_ring[slot].known_switched;
+    record->gain_epoch = adc_ring[slot].gain_epoch;
+    record->gain_code = adc_ring[slot].gain_code;
+    return 1;
+}
+
+
+// Copy and release the oldest unread record. Returns 0 if the ring is empty.
+uint8_t adc_ring_read(adc_record_t *record)
+{
+    if(!adc_ring_peek(0, record)) { return 0; }
+    adc_ring_tail = (adc_ring_tail + 1) & (ADC_RING_SIZE - 1);
+    return 1;
+}
+
+
+// Release every unread record.
+void adc_ring_discard(void)
+{
+    adc_ring_tail = adc_ring_head;
+}
+
+
+// Filter the pending FWD/REF pair from the ADC interrupt, then publish the
+// output pair and flag it as new. FWD and REF share every conversion slot, so
+// their filters produce output together; both are fed and both must have output
+// before a pair is published. The filters restart whenever the known impedance
+// is switched so a pair never mixes the two settings.
+void publish_swr_pair(void)
+{
+    volatile swr_pair_t *pair = seq_known_switched ? &swr_known_pair : &swr_pair;
+    uint16_t fwd, ref;
+
+    if((seq_known_switched != filter_known_switched) || (seq_gain_epoch != filter_gain_epoch))
+    {
+        reset_adc_filter(&fwd_filter);
+        reset_adc_filter(&ref_filter);
+        filter_known_switched = seq_known_switched;
+        filter_gain_epoch = seq_gain_epoch;
+    }
+    if(seq_gain_epoch != agc_epoch) { return; } // Gain changed part way through the pair
+    // Bitwise or, so the REF filter is fed even when FWD has no output
+    if(!update_adc_filter(&fwd_filter, pending_pair.fwd, &fwd) |
+       !update_adc_filter(&ref_filter, pending_pair.ref, &ref)) { return; }
+
+    pair->fwd = fwd;
+    pair->ref = ref;
+    pair->timestamp = TB3R;
+    pair->gain_epoch = seq_gain_epoch;
+    pair->gain_code = wiper_code; // Unchanged since the pair started, the epoch matches
+    pair->seq++;
+    push_adc_record(pair->timestamp, fwd, ref);
+    if(seq_known_switched)
+    {
+        adc_flg |= SWR_KNOWN_SENSE;
+        P3OUT &= ~BIT6; // Switch out impedance after reading FWD and REF
+        adc_flg &= ~IMP_SWITCH;
+    } else {
+        adc_flg |= SWR_SENSE;
+    }
+}
+
+
+// Copy the latest FWD/REF pair for the given impedance setting. The copy is
+// retried if the ADC interrupt publishes a new pair part way through.
+void get_swr_pair(uint8_t reflection_to_calc, swr_pair_t *pair)
+{
+    volatile swr_pair_t *source = (reflection_to_calc == KNOWN_SWITCHED_IN) ? &swr_known_pair : &swr_pair;
+    uint16_t seq;
+
+    do {
+        seq = source->seq;
+        pair->fwd = source->fwd;
+        pair->ref = source->ref;
+        pair->timestamp = source->timestamp;
+        pair->gain_epoch = source->gain_epoch;
+        pair->gain_code = source->gain_code;
+        pair->seq = seq;
+    } while(seq != source->seq);
 }
 
 
@@ -62,54 +387,108 @@ inline void sample_adc_channel(uint8_t adc_channel)
     ADCCTL0 &= ~ADCENC;
     ADCMCTL0 &= ~ADCINCH;
     ADCMCTL0 |= adc_channel;
+    arm_adc_window((adc_channel == FWD_PIN) ? (ADCHIIE | ADCLOIE) : 0);
     adc_flg &= ~ADC_STATUS;
-    TB0CCR1  = TB0R + 2; // Time delay to let adc channel RC circuit charge
+    TB0CCR1  = TB0R + ADC_SETTLE_TICKS; // Time delay to let adc channel RC circuit charge
 }
 
 
 // TODO: Function to update adc sample to most recent value
 inline void update_adc_value(uint16_t adc_reading)
 {
+    uint16_t filtered;
+
     switch(adc_channel_select)
     {
     case FWD_PIN:
+        // Convert REF straight away, without the timer delay, to pair it with FWD
         adc_channel_select = REF_PIN;
-        if(adc_flg & IMP_SWITCH) // The known impedance is switched in
-        {
-            fwd_25_sample = adc_reading;
-        } else {
-            fwd_sample = adc_reading;
-        }
-        break;
+        seq_known_switched = adc_flg & IMP_SWITCH;
+        seq_gain_epoch = agc_epoch;
+        arm_adc_window(ADCHIIE);
+        pending_pair.fwd = adc_reading;
+        ADCCTL0 &= ~ADCENC;
+        ADCMCTL0 &= ~ADCINCH;
+        ADCMCTL0 |= REF_PIN;
+        ADCCTL0 |= ADCENC | ADCSC;
+        return;
 
     case REF_PIN:
         adc_channel_select = IND_PIN;
-        if(adc_flg & IMP_SWITCH) // The known impedance is switched in
-        {
-            ref_25_sample = adc_reading;
-            adc_flg |= SWR_KNOWN_SENSE;
-            P3OUT &= ~BIT6; // Switch out impedance after reading FWD and REF
-            adc_flg &= ~IMP_SWITCH;
-        } else {
-            ref_sample = adc_reading;
-            adc_flg |= SWR_SENSE;
-        }
+        arm_adc_window(0);
+        pending_pair.ref = adc_reading;
+        publish_swr_pair();
         break;
 
     case IND_PIN:
         adc_channel_select = CAP_PIN;
-        ind_sample = adc_reading;
-        adc_flg |= IND_POT;
+        if(update_adc_filter(&ind_filter, adc_reading, &filtered)) {
+            ind_sample = filtered >> ADC_FILTER_MAX_SHIFT;
+            adc_flg |= IND_POT;
+        }
         break;
 
     case CAP_PIN:
         adc_channel_select = FWD_PIN;
-        cap_sample = adc_reading;
-        adc_flg |= CAP_POT;
+        if(update_adc_filter(&cap_filter, adc_reading, &filtered)) {
+            cap_sample = filtered >> ADC_FILTER_MAX_SHIFT;
+            adc_flg |= CAP_POT;
+        }
         break;
     }
     adc_flg |= ADC_STATUS;
-    TB0CCR1  = TB0R + 4; // Time delay to next adc sample interval
+    TB0CCR1  = TB0R + ADC_INTERVAL_TICKS; // Time delay to next adc sample interval
+}
+
+
+// Store one result of a channel sequence. Channels arrive from A11 down, so REF
+// comes before FWD and the FWD result completes the pair. The sequence is
+// stopped after the last channel of its segment.
+inline void update_adc_sequence(uint16_t adc_reading)
+{
+    uint16_t filtered;
+
+    switch(adc_channel_select)
+    {
+    case REF_PIN:
+        arm_adc_window(ADCHIIE | ADCLOIE); // FWD is converting now
+        pending_pair.ref = adc_reading;
+        break;
+
+    case FWD_PIN:
+        arm_adc_window(0); // The next channel is a pot
+        pending_pair.fwd = adc_reading;
+        publish_swr_pair();
+        break;
+
+    case IND_PIN:
+        if(update_adc_filter(&ind_filter, adc_reading, &filtered)) {
+            ind_sample = filtered >> ADC_FILTER_MAX_SHIFT;
+            adc_flg |= IND_POT;
+        }
+        break;
+
+    case CAP_PIN:
+        if(update_adc_filter(&cap_filter, adc_reading, &filtered)) {
+            cap_sample = filtered >> ADC_FILTER_MAX_SHIFT;
+            adc_flg |= CAP_POT;
+        }
+        break;
+
+    default:
+        return; // Conversion of an unused channel finishing after the stop
+    }
+    if(adc_channel_select == seq_last_channel)
+    {
+        // Stop the sequence before it converts channels outside the segment
+        ADCCTL1 &= ~ADCCONSEQ;
+        ADCCTL0 &= ~ADCENC;
+        adc_channel_select = 0;
+        adc_flg |= ADC_STATUS;
+        TB0CCR1  = TB0R + seq_gap_ticks; // Time delay to next sequence
+        return;
+    }
+    adc_channel_select--;
 }
 
 
@@ -125,14 +504,18 @@ __interrupt void ADC_ISR(void)
     break;
   case ADCIV_ADCTOVIFG:
     break;
-  case ADCIV_ADCHIIFG:
+  case ADCIV_ADCHIIFG: // FWD or REF over range
+    digipot_back_off();
     break;
-  case ADCIV_ADCLOIFG:
+  case ADCIV_ADCLOIFG: // FWD under range
+    ADCIE &= ~ADCLOIE;
+    adc_flg |= ADC_UNDER_RANGE;
     break;
   case ADCIV_ADCINIFG:
     break;
   case ADCIV_ADCIFG:
-    update_adc_value(ADCMEM0);
+    if(adc_mode == ADC_MODE_SEQUENCE) { update_adc_sequence(ADCMEM0); }
+    else { update_adc_value(ADCMEM0); }
     break;
   default:
     break;
@@ -147,7 +530,10 @@ __interrupt void Timer0_B1(void)
     {
         case TBIV_2: // CCR1 caused the interrupt - used for adc_sampling
         {
-          if(adc_flg & ADC_STATUS) // ADC is ready to sample next channel
+          if(adc_mode == ADC_MODE_SEQUENCE)
+          {
+              if(adc_flg & ADC_STATUS) { start_adc_sequence(); }
+          } else if(adc_flg & ADC_STATUS) // ADC is ready to sample next channel
           {
               sample_adc_channel(adc_channel_select);
           } else if(!(ADCCTL0 & ADCENC))
@@ -162,5 +548,11 @@ __interrupt void Timer0_B1(void)
           asm("   NOP");
           break;
         }
+
+        case TBIV_14: // Timer overflow, extends the frequency counter time base
+        {
+          timer0_overflows++;
+          break;
+        }
     }
 }
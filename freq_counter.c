@@ -6,39 +6,208 @@
  * Description: This file will contain the functions necessary to determine
  *              the frequency of the transmitted RF wave.
  *
+ *              The counter works reciprocally. Timer1 counts the input divided by 16
+ *              and Timer0 (SMCLK / 8) timestamps its edges. A gate opens on one edge,
+ *              Timer1 CCR0 interrupts after a set number of edges, and the gate closes
+ *              on the next edge after that. Frequency is the edge count over the
+ *              elapsed time, so resolution depends on the gate time, not the input
+ *              frequency. One Timer0 tick in a 16 ms gate is about 1 kHz at 54 MHz,
+ *              and much less further down.
+ *
+ *              Gates run back to back. The edge that closes one gate opens the next in
+ *              the same interrupt, so no input cycles go uncounted. Each closed gate is
+ *              pushed with its Timer3 timestamp into freq_history. measure_freq()
+ *              takes the ratio of the summed edges and time over the latest gates as
+ *              the smoothed frequency, which equals one longer gate with no dead time.
+ *
+ *              Gate length adapts in the interrupt without division. After the signal
+ *              is lost, gates start at FREQ_COUNT_MIN counts and double until they
+ *              last at least half of FREQ_GATE_TICKS, 16 ms. The edge count is 16
+ *              bits, so the last step goes from 0x8000 counts to FREQ_COUNT_MAX.
+ *              That keeps gates at 16 ms or more up to 61 MHz, 18 ms at 54 MHz,
+ *              where 0x8000 counts would last under 10 ms. Timer3 CCR5 stops the
+ *              pipeline when a gate does not close, which means no signal, and
+ *              measure_freq() restarts it.
+ *
+ *              A step in frequency larger than freq_hysteresis, seen on
+ *              FREQ_CHANGE_GATES gates in a row, is taken as a change of band. The
+ *              average then restarts from the new gates instead of blending across
+ *              the step, and frequency_moved() lets a running tune see the change.
+ *              Each new gate is judged once, however often measure_freq() runs, and
+ *              gates held back that turn out to be a glitch are left out of the
+ *              average.
+ *              The hysteresis is set in kHz from its settings menu.
+ *
  ******************************************************************************/
 
 #include "intellitune.h"
 
 // Globals
-uint16_t overflowCount;
-uint16_t frequency;
-uint32_t total_pulses;
+uint32_t frequency; // Smoothed over the latest gates, Hz
+uint32_t freq_latest; // Latest gate alone, Hz
+volatile uint8_t freq_state = FREQ_IDLE;
+uint16_t freq_gate_counts = FREQ_COUNT_MIN; // Input edges / 16 per gate
+uint16_t freq_start_count;
+uint32_t freq_start_time;
+volatile freq_record_t freq_history[FREQ_HISTORY_SIZE];
+volatile uint8_t freq_history_head = 0; // Next record to fill
+uint8_t freq_history_seen = 0; // Head at the last measure_freq()
+uint8_t freq_gates_valid = 0; // Gates since the last change of frequency
+uint8_t freq_change_count = 0; // Consecutive gates beyond the hysteresis
+#pragma PERSISTENT(freq_hysteresis)
+uint16_t freq_hysteresis = FREQ_HYSTERESIS_DEFAULT; // kHz, kept in FRAM
 
 
 // Function Prototypes
 void measure_freq(void);
 void initialize_freq_counter(void);
+void freq_gate_timeout(void);
+uint8_t frequency_moved(uint32_t reference);
+
+
+// Read Timer1, which runs from the asynchronous input, until two reads agree.
+static uint16_t read_freq_count(void)
+{
+    uint16_t count;
+
+    do {
+        count = TB1R;
+    } while(count != TB1R);
+    return count;
+}
+
+
+// Wait for the next edge of the prescaled input and return its Timer0 timestamp
+// with the Timer1 count it reached. Gives up after FREQ_SYNC_LOOPS reads when
+// there is no input. Must be called with interrupts disabled.
+static uint32_t freq_edge_time(uint16_t *count)
+{
+    uint16_t first, now, low, high;
+    uint8_t loops = FREQ_SYNC_LOOPS;
+
+    first = read_freq_count();
+    do {
+        now = read_freq_count();
+    } while((now == first) && --loops);
+    low = TB0R;
+    high = timer0_overflows;
+    if((TB0CTL & TBIFG) && !(low & 0x8000)) { high++; } // Overflow not yet counted
+    *count = now;
+    return ((uint32_t)high << 16) | low;
+}
+
+
+// Convert summed edges and Timer0 ticks to Hz.
+static uint32_t freq_from_counts(uint32_t edges, uint32_t ticks)
+{
+    return (uint32_t)((((uint64_t)edges * FREQ_HZ_SCALE) + (ticks / 2)) / ticks);
+}
 
 
-// TODO: Implement frequency measuring
+// Return 1 if two frequencies differ by more than the hysteresis.
+static uint8_t freq_outside_hysteresis(uint32_t a, uint32_t b)
+{
+    return ((a > b) ? (a - b) : (b - a)) > ((uint32_t)freq_hysteresis * 1000);
+}
+
+
+// Return 1 if the measured frequency has left the hysteresis band around the
+// reference. Loss of signal is not a change, the carrier may just be keyed off.
+uint8_t frequency_moved(uint32_t reference)
+{
+    if(frequency == 0) { return 0; }
+    return freq_outside_hysteresis(frequency, reference);
+}
+
+
+// Update the frequency from the gates closed since the last call, or restart the
+// gate pipeline after it stopped for lack of signal. Called from a task.
 void measure_freq(void)
 {
-    static const uint8_t timing_correction = 3;
+    uint32_t edges = 0, ticks = 0, latest_edges = 0, latest_ticks = 0, gate_ticks;
+    uint16_t gate_edges;
+    uint8_t i, index, head, new_gates;
 
-    if(TB1CTL != MC_0) { return; } // Frequency is currently being measured
-    // Timer1_B3 and Timer0_B3 setup
+    if(freq_state == FREQ_IDLE)
+    {
+        frequency = 0;
+        freq_latest = 0;
+        freq_gate_counts = FREQ_COUNT_MIN;
+        freq_gates_valid = 0;
+        freq_change_count = 0;
 
-    overflowCount = 0;
+        // Open the first gate on an edge, with the compare armed before it can pass
+        __bic_SR_register(GIE);
+        freq_start_time = freq_edge_time(&freq_start_count);
+        TB1CCR0 = freq_start_count + freq_gate_counts;
+        TB1CCTL0 = CCIE;
+        freq_state = FREQ_GATE;
+        TB3CCR5 = TB3R + FREQ_TIMEOUT_TICKS;
+        TB3CCTL5 = CCIE;
+        __bis_SR_register(GIE);
+        return;
+    }
+    head = freq_history_head;
+    if(head == freq_history_seen) { return; }
+    new_gates = (head - freq_history_seen) & (FREQ_HISTORY_SIZE - 1);
+    freq_gates_valid += new_gates;
+    freq_history_seen = head;
 
-    //Reset the timer1 count register to 0.
-    TB1R = 0;
+    // Judge each new gate once, oldest first, so a run of gates beyond the
+    // hysteresis counts gates and not calls. Held gates that are not confirmed
+    // are left out of the average.
+    for(i = new_gates; (frequency != 0) && (i-- > 0);)
+    {
+        index = (head - 1 - i) & (FREQ_HISTORY_SIZE - 1);
+        __bic_SR_register(GIE);
+        gate_edges = freq_history[index].edges;
+        gate_ticks = freq_history[index].ticks;
+        __bis_SR_register(GIE);
+        if(gate_ticks < FREQ_MIN_TICKS) { continue; }
+        if(freq_outside_hysteresis(freq_from_counts(gate_edges, gate_ticks), frequency)) {
+            freq_change_count++;
+        } else {
+            if(freq_change_count != 0) { freq_gates_valid = i + 1; } // This gate and the newer ones
+            freq_change_count = 0;
+        }
+    }
+    if(freq_gates_valid > FREQ_SMOOTH_GATES) { freq_gates_valid = FREQ_SMOOTH_GATES; }
 
-    // TBCCR0 interrupt enabled and set interval to 1 sec
-    TB3CCR5 = TB3R + 32768 + timing_correction;
-    TB3CCTL5 = CCIE;
-    // 16-bit, TBxCLK, halt mode, divide by 4, enable Interrupt
-    TB1CTL = (CNTL_0 | TBSSEL_0 | MC__CONTINUOUS | ID_2 | TBIE);
+    // Sum the latest full length gates. Interrupts are held off so the
+    // interrupt cannot refill a record while it is summed.
+    __bic_SR_register(GIE);
+    for(i = 0; i < freq_gates_valid; i++)
+    {
+        index = (head - 1 - i) & (FREQ_HISTORY_SIZE - 1);
+        if(freq_history[index].ticks < FREQ_MIN_TICKS) { break; } // Acquisition gate or empty
+        edges += freq_history[index].edges;
+        ticks += freq_history[index].ticks;
+        if(i == 0) { latest_edges = edges; latest_ticks = ticks; }
+    }
+    __bis_SR_register(GIE);
+
+    if(ticks == 0) { return; } // Still acquiring
+    freq_latest = freq_from_counts(latest_edges, latest_ticks);
+
+    // A confirmed step restarts the average from the newest gate
+    if(freq_change_count >= FREQ_CHANGE_GATES) {
+        freq_change_count = 0;
+        freq_gates_valid = 1;
+        frequency = freq_latest;
+        return;
+    }
+    if(freq_change_count != 0) { return; } // Hold the old value until confirmed
+    frequency = freq_from_counts(edges, ticks);
+}
+
+
+// Timer3 CCR5 expired before the gate closed, there is no input signal.
+void freq_gate_timeout(void)
+{
+    TB1CCTL0 = CCIE_0;
+    TB3CCTL5 = CCIE_0;
+    freq_history[(freq_history_head - 1) & (FREQ_HISTORY_SIZE - 1)].ticks = 0; // Not part of the next average
+    freq_state = FREQ_IDLE;
 }
 
 
@@ -53,12 +222,40 @@ void initialize_freq_counter(void)
 
     // IDEX divide by 4
     TB1EX0 = TBIDEX_3;
+    // 16-bit, TBxCLK, continuous mode, divide by 4
+    TB1CTL = (CNTL_0 | TBSSEL_0 | MC__CONTINUOUS | ID_2 | TBCLR);
 }
 
 
-#pragma vector=TIMER1_B1_VECTOR
-__interrupt void Timer1_B1(void)
+// Timer1 reached the gate length. Close the gate on the next edge, record it and
+// open the next gate on the same edge.
+#pragma vector=TIMER1_B0_VECTOR
+__interrupt void Timer1_B0(void)
 {
-    overflowCount++;
-    TB1IV = 0;
+    volatile freq_record_t *record = &freq_history[freq_history_head];
+    uint16_t count, gate = freq_gate_counts;
+    uint32_t time, ticks;
+
+    time = freq_edge_time(&count);
+    record->timestamp = TB3R;
+    record->edges = count - freq_start_count;
+    record->ticks = time - freq_start_time;
+    freq_history_head = (freq_history_head + 1) & (FREQ_HISTORY_SIZE - 1);
+
+    // Scale the gate by powers of two toward FREQ_GATE_TICKS
+    ticks = record->ticks;
+    while((ticks < (FREQ_GATE_TICKS / 2)) && (gate < FREQ_COUNT_MAX)) {
+        gate = (gate < 0x8000) ? (gate << 1) : FREQ_COUNT_MAX;
+        ticks <<= 1;
+    }
+    while((ticks > FREQ_GATE_TICKS) && (gate > FREQ_COUNT_MIN)) {
+        gate = (gate > 0x8000) ? 0x8000 : (gate >> 1);
+        ticks >>= 1;
+    }
+    freq_gate_counts = gate;
+
+    freq_start_time = time;
+    freq_start_count = count;
+    TB1CCR0 = count + gate;
+    TB3CCR5 = TB3R + FREQ_TIMEOUT_TICKS;
 }
@@ -0,0 +1,282 @@
+/*
+ * File: bench.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Tune benchmark on the host simulator. Each load of a corpus is tuned
+ *              from the same power on state, in a forked copy of the simulation,
+ *              with the carrier keyed at its frequency before TUNE is pressed.
+ *
+ *              For every tune it prints the step pulses the drivers saw, the
+ *              simulated time from the button press until the firmware clears TUNE
+ *              and the VSWR the network really gives the transmitter at the end.
+ *              The firmware's own tune_report figures are added with -r, among them
+ *              the time spent in the fine tune, the homing time skipped by starting
+ *              from the current position and whether the AGC held lock for the final
+ *              SWR reading. The summary gives the tune time percentiles over the run.
+ *
+ *              A Touchstone file in place of the corpus is swept: the measured load
+ *              is tuned at evenly spaced frequencies across its range, clipped to
+ *              the tuner's 1.8 - 54 MHz.
+ *
+ *              Usage: bench [-r] [-n] [-c] [-p watts] [-s seed] [-N points] [corpus | file.s1p]
+ *                  -r  add the tune_report columns
+ *                  -n  add pot and detector noise
+ *                  -c  tune each load from where the last tune left the network, with
+ *                      the tune memory kept, instead of from the power on state
+ *                  -N  frequency points of a sweep, 200 by default
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "intellitune.h"
+#include "sim.h"
+
+
+#define MAX_LOADS                   1024
+#define DEFAULT_SWEEP_POINTS        200
+#define SWEEP_MIN_HZ                1.8e6 // Tuner range
+#define SWEEP_MAX_HZ                54.0e6
+#define SETTLE_S                    2.0 // Power on until the firmware is idle
+#define CARRIER_LEAD_S              0.1 // Carrier keyed before TUNE is pressed
+#define CARRIER_GAP_S               0.5 // Carrier off between tunes with -c
+#define TUNE_TIMEOUT_S              60.0
+#define DEFAULT_POWER_W             100.0
+#define START_POSITION              2048.0 // Pots at power on, away from either limit
+#define NOISE_POT_COUNTS            1.0
+#define NOISE_DETECTOR_COUNTS       2.0
+
+
+typedef struct
+{
+    uint8_t finished;
+    uint32_t steps;             // Step pulses seen at both drivers
+    double ms;                  // Simulated time from the press to TUNE clearing
+    double vswr;                // True VSWR through the final network
+    uint32_t report_steps;      // tune_report figures
+    uint16_t report_ms;
+    uint16_t report_fine_ms, report_saved_ms;
+    double report_vswr;
+    uint8_t recall, restarts, agc_locked;
+} bench_result_t;
+
+
+static uint8_t tune_finished(void)
+{
+    return !(button_press & TUNE);
+}
+
+
+// Tune one load in this process.
+static void bench_tune(const sim_load_t *load, double freq_hz, double power_w, bench_result_t *result)
+{
+    double start;
+    uint32_t steps = sim_hw.cap_steps + sim_hw.ind_steps;
+
+    sim_set_load(load);
+    sim_key(freq_hz, power_w);
+    sim_run(CARRIER_LEAD_S);
+    start = sim_now;
+    sim_press_tune();
+    result->finished = sim_run_until(tune_finished, TUNE_TIMEOUT_S);
+    result->ms = (sim_now - start) * 1000.0;
+    result->steps = sim_hw.cap_steps + sim_hw.ind_steps - steps;
+    result->vswr = sim_matched_vswr(freq_hz, sim_load_impedance(load, freq_hz), &sim_hw);
+    result->report_steps = tune_report.cap_steps + tune_report.ind_steps;
+    result->report_ms = tune_report.duration_ms;
+    result->report_fine_ms = tune_report.fine_tune_ms;
+    result->report_saved_ms = tune_report.homing_saved_ms;
+    result->report_vswr = tune_report.final_vswr / 65536.0;
+    result->recall = tune_report.recall;
+    result->restarts = tune_report.restarts;
+    result->agc_locked = tune_report.agc_locked;
+}
+
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+// Nearest rank percentile of a sorted set.
+static double percentile(const double *sorted, int count, int percent)
+{
+    int rank = (count * percent + 99) / 100;
+
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+
+// Spread a measured load over evenly spaced frequencies within the tuner range.
+static int sweep_points(const sim_load_t *table, int points, sim_load_t *loads, double *freq_hz)
+{
+    double start = table->table_hz[0], stop = table->table_hz[table->table_points - 1];
+    int i;
+
+    if(start < SWEEP_MIN_HZ) { start = SWEEP_MIN_HZ; }
+    if(stop > SWEEP_MAX_HZ) { stop = SWEEP_MAX_HZ; }
+    if(stop < start) { return 0; }
+    if(points > MAX_LOADS) { points = MAX_LOADS; }
+    for(i = 0; i < points; i++)
+    {
+        loads[i] = *table;
+        freq_hz[i] = (points > 1) ? start + (stop - start) * i / (points - 1) : start;
+    }
+    return points;
+}
+
+
+// Tune a load in a forked copy of the simulation, leaving this one untouched.
+static void bench_tune_forked(const sim_load_t *load, double freq_hz, double power_w, bench_result_t *result)
+{
+    int pipe_fd[2];
+    pid_t child;
+
+    memset(result, 0, sizeof(*result));
+    if(pipe(pipe_fd) != 0) { perror("pipe"); exit(1); }
+    child = fork();
+    if(child < 0) { perror("fork"); exit(1); }
+    if(child == 0)
+    {
+        close(pipe_fd[0]);
+        bench_tune(load, freq_hz, power_w, result);
+        if(write(pipe_fd[1], result, sizeof(*result)) != sizeof(*result)) { _exit(1); }
+        _exit(0);
+    }
+    close(pipe_fd[1]);
+    if(read(pipe_fd[0], result, sizeof(*result)) != sizeof(*result)) { result->finished = 0; }
+    close(pipe_fd[0]);
+    waitpid(child, NULL, 0);
+}
+
+
+int main(int argc, char **argv)
+{
+    static sim_load_t loads[MAX_LOADS];
+    static double freq_hz[MAX_LOADS], tune_ms[MAX_LOADS], tune_steps[MAX_LOADS];
+    static const char *recall_names[] = { "none", "stored", "interp" };
+    sim_options_t options = {0};
+    sim_load_t table;
+    bench_result_t result, total = {0};
+    const char *corpus = "loads.txt", *extension;
+    double power_w = DEFAULT_POWER_W, worst_vswr = 0.0, fine_ms = 0.0, saved_ms = 0.0;
+    int count, i, opt, report = 0, continuous = 0, points = DEFAULT_SWEEP_POINTS, matched = 0, timeouts = 0,
+        unlocked = 0;
+
+    options.seed = 1;
+    while((opt = getopt(argc, argv, "rncp:s:N:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'r':
+            report = 1;
+            break;
+        case 'n':
+            options.noise_pot = NOISE_POT_COUNTS;
+            options.noise_detector = NOISE_DETECTOR_COUNTS;
+            break;
+        case 'c':
+            continuous = 1;
+            break;
+        case 'p':
+            power_w = atof(optarg);
+            break;
+        case 's':
+            options.seed = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'N':
+            points = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-n] [-c] [-p watts] [-s seed] [-N points] [corpus | file.s1p]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if(optind < argc) { corpus = argv[optind]; }
+    extension = strrchr(corpus, '.');
+    if(extension && (strcasecmp(extension, ".s1p") == 0)) {
+        count = (sim_load_touchstone(corpus, &table) > 0) ? sweep_points(&table, points, loads, freq_hz) : -1;
+    } else {
+        count = sim_load_corpus(corpus, loads, freq_hz, MAX_LOADS);
+    }
+    if(count <= 0)
+    {
+        fprintf(stderr, "%s: no loads read from %s\n", argv[0], corpus);
+        return 1;
+    }
+
+    sim_reset(&options);
+    sim_set_positions(START_POSITION, START_POSITION);
+    sim_power_up();
+    sim_run(SETTLE_S);
+
+    printf("%-16s %8s %15s %7s %9s %7s", "load", "MHz", "Z load", "steps", "ms", "VSWR");
+    if(report) {
+        printf(" %7s %7s %7s %7s %7s %6s %3s %4s", "fw stp", "fw ms", "fine ms", "saved", "fw SWR", "recall", "rst",
+               "agc");
+    }
+    printf("\n");
+    fflush(stdout);
+
+    for(i = 0; i < count; i++)
+    {
+        double complex z = sim_load_impedance(&loads[i], freq_hz[i]);
+
+        if(continuous) {
+            memset(&result, 0, sizeof(result));
+            bench_tune(&loads[i], freq_hz[i], power_w, &result);
+            sim_unkey();
+            sim_run(CARRIER_GAP_S);
+        } else {
+            bench_tune_forked(&loads[i], freq_hz[i], power_w, &result);
+        }
+
+        printf("%-16s %8.3f %7.1f%+7.1fj %7u %9.1f %7.2f", loads[i].name, freq_hz[i] / 1e6,
+               creal(z), cimag(z), result.steps, result.ms, result.vswr);
+        if(report)
+        {
+            printf(" %7u %7u %7u %7u %7.2f %6s %3u %4s", result.report_steps, result.report_ms, result.report_fine_ms,
+                   result.report_saved_ms, result.report_vswr, recall_names[result.recall < 3 ? result.recall : 0],
+                   result.restarts, result.agc_locked ? "lock" : "-");
+        }
+        printf("%s\n", result.finished ? "" : "  (timed out)");
+        fflush(stdout);
+
+        tune_ms[i] = result.ms;
+        tune_steps[i] = result.steps;
+        total.steps += result.steps;
+        total.ms += result.ms;
+        fine_ms += result.report_fine_ms;
+        saved_ms += result.report_saved_ms;
+        if(result.finished && !result.agc_locked) { unlocked++; }
+        if(result.vswr > worst_vswr) { worst_vswr = result.vswr; }
+        if(!result.finished) { timeouts++; }
+        else if(result.vswr <= TARGET_SWR_MAX / 10.0) { matched++; }
+    }
+
+    qsort(tune_ms, count, sizeof(tune_ms[0]), compare_double);
+    qsort(tune_steps, count, sizeof(tune_steps[0]), compare_double);
+    printf("\n%d loads, %d matched to %.1f:1, %d timed out, mean %.0f steps and %.1f ms per tune, worst VSWR %.2f\n",
+           count, matched, TARGET_SWR_MAX / 10.0, timeouts, (double)total.steps / count, total.ms / count,
+           worst_vswr);
+    printf("tune ms   p50 %7.0f  p90 %7.0f  p95 %7.0f  p99 %7.0f  max %7.0f\n",
+           percentile(tune_ms, count, 50), percentile(tune_ms, count, 90), percentile(tune_ms, count, 95),
+           percentile(tune_ms, count, 99), tune_ms[count - 1]);
+    printf("steps     p50 %7.0f  p90 %7.0f  p95 %7.0f  p99 %7.0f  max %7.0f\n",
+           percentile(tune_steps, count, 50), percentile(tune_steps, count, 90),
+           percentile(tune_steps, count, 95), percentile(tune_steps, count, 99), tune_steps[count - 1]);
+    if(report) {
+        printf("firmware  mean %.1f ms fine tuning and %.1f ms homing skipped per tune, %d finished without AGC lock\n",
+               fine_ms / count, saved_ms / count, unlocked);
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * File: detector_fit.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Fits the FWD and REF detector linearization tables from recorded
+ *              calibration data. Each point is a reading the firmware published,
+ *              ADC_HIRES scale, the digipot code it was taken at and the true RF
+ *              voltage measured at the same time, with a power meter or a
+ *              calibrated source. The voltage may be in any unit as long as both
+ *              channels share it.
+ *
+ *              Readings are referred to full gain as linearize_detector() does.
+ *              The table is piecewise linear between octaves, so each point weights
+ *              the two table entries around it and the fit is linear least squares
+ *              in the entries. Errors are taken relative to the true value, the
+ *              table spans sixteen octaves. A weak penalty on each entry against
+ *              twice the one below keeps octaves without data on a straight line.
+ *
+ *              Volts become table units by one scale, chosen so the strongest FWD
+ *              point maps to itself. The diodes are linear at high power, so the top
+ *              of the table stays close to the identity and ADC_RF_PRESENT_MIN keeps
+ *              its meaning.
+ *
+ *              A calibration file holds one point per line, "fwd|ref <gain code>
+ *              <reading> <volts>". Comments start with '!'.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "intellitune.h"
+#include "sim.h"
+
+
+#define FIT_SMOOTHING               1e-3 // Penalty weight, against one point's
+
+
+// Reading referred to full gain, as linearize_detector() finds it.
+static double detector_output(const sim_det_point_t *point)
+{
+    return point->reading * (double)(AGC_CODE_MAX + 1) / (AGC_CODE_MAX + 1 - point->gain_code);
+}
+
+
+// Weights of the table entries for a detector output: the entry at or below it
+// and the fraction of the way to the next. Below the table the first entry is
+// scaled toward zero, above it the last entry holds.
+static uint8_t table_weights(double detector, double *lower, double *upper)
+{
+    int octave;
+
+    if(detector < (1UL << DET_TABLE_BASE_SHIFT)) {
+        *lower = detector / (1UL << DET_TABLE_BASE_SHIFT);
+        *upper = 0.0;
+        return 0;
+    }
+    octave = (int)floor(log2(detector));
+    if(octave >= DET_TABLE_BASE_SHIFT + DET_TABLE_POINTS - 1) {
+        *lower = 1.0;
+        *upper = 0.0;
+        return DET_TABLE_POINTS - 1;
+    }
+    *upper = detector / ldexp(1.0, octave) - 1.0;
+    *lower = 1.0 - *upper;
+    return octave - DET_TABLE_BASE_SHIFT;
+}
+
+
+// Read a calibration file. Returns the number of points, or -1 if the file
+// cannot be read or a line is malformed.
+int sim_read_calibration(const char *path, sim_det_point_t *points, int max_points)
+{
+    FILE *file = fopen(path, "r");
+    char line[256], name[8];
+    unsigned code, reading;
+    double volts;
+    int count = 0, number = 0;
+
+    if(file == NULL) { return -1; }
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        if(strchr(line, '!') != NULL) { *strchr(line, '!') = '\0'; }
+        if(strspn(line, " \t\r\n") == strlen(line)) { continue; }
+        if((sscanf(line, "%7s %u %u %lf", name, &code, &reading, &volts) != 4) || (code > AGC_CODE_MAX) ||
+           (reading > 0xFFFF) || (volts <= 0.0) || ((strcasecmp(name, "fwd") != 0) && (strcasecmp(name, "ref") != 0)))
+        {
+            fprintf(stderr, "%s:%d: expected fwd|ref <gain code> <reading> <volts>\n", path, number);
+            fclose(file);
+            return -1;
+        }
+        if(count == max_points) { break; }
+        points[count].channel = (strcasecmp(name, "fwd") == 0) ? DET_FWD : DET_REF;
+        points[count].gain_code = (uint8_t)code;
+        points[count].reading = (uint16_t)reading;
+        points[count].volts = volts;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+
+// Table units per volt: the strongest FWD point maps to its own detector output.
+// Returns 0 if there is no FWD point.
+double sim_detector_scale(const sim_det_point_t *points, int count)
+{
+    double strongest = 0.0, scale = 0.0;
+    int i;
+
+    for(i = 0; i < count; i++)
+    {
+        if((points[i].channel != DET_FWD) || (detector_output(&points[i]) <= strongest)) { continue; }
+        strongest = detector_output(&points[i]);
+        scale = strongest / points[i].volts;
+    }
+    return scale;
+}
+
+
+// Fit the DET_TABLE_POINTS entries of one channel's table. Returns the number of
+// points used, 0 if the channel has none and the table is left alone.
+int sim_fit_detector(const sim_det_point_t *points, int count, uint8_t channel, double scale, uint32_t *table)
+{
+    double diag[DET_TABLE_POINTS] = {0}, off[DET_TABLE_POINTS] = {0}, rhs[DET_TABLE_POINTS] = {0};
+    double lower, upper, target, weight, knot, factor;
+    int i, used = 0;
+    uint8_t j;
+
+    // Normal equations, tridiagonal since each point touches two neighbouring entries
+    for(i = 0; i < count; i++)
+    {
+        if(points[i].channel != channel) { continue; }
+        j = table_weights(detector_output(&points[i]), &lower, &upper);
+        target = points[i].volts * scale;
+        weight = 1.0 / (target * target);
+        diag[j] += weight * lower * lower;
+        rhs[j] += weight * lower * target;
+        if(upper > 0.0)
+        {
+            diag[j + 1] += weight * upper * upper;
+            off[j] += weight * lower * upper;
+            rhs[j + 1] += weight * upper * target;
+        }
+        used++;
+    }
+    if(used == 0) { return 0; }
+
+    // Penalty on (entry - 2 * entry below), relative to the entry's octave
+    for(j = 1; j < DET_TABLE_POINTS; j++)
+    {
+        knot = ldexp(1.0, DET_TABLE_BASE_SHIFT + j);
+        weight = FIT_SMOOTHING / (knot * knot);
+        diag[j] += weight;
+        diag[j - 1] += 4.0 * weight;
+        off[j - 1] -= 2.0 * weight;
+    }
+
+    // Thomas algorithm, forward elimination then back substitution
+    for(j = 1; j < DET_TABLE_POINTS; j++)
+    {
+        factor = off[j - 1] / diag[j - 1];
+        diag[j] -= factor * off[j - 1];
+        rhs[j] -= factor * rhs[j - 1];
+    }
+    rhs[DET_TABLE_POINTS - 1] /= diag[DET_TABLE_POINTS - 1];
+    for(j = DET_TABLE_POINTS - 1; j-- > 0;) { rhs[j] = (rhs[j] - off[j] * rhs[j + 1]) / diag[j]; }
+
+    for(j = 0; j < DET_TABLE_POINTS; j++) { table[j] = (rhs[j] < 1.0) ? 1 : (uint32_t)lround(rhs[j]); }
+    return used;
+}
+
+
+// Worst error of a fitted table over one channel's points, relative to the true
+// value. The table is interpolated in double precision.
+double sim_detector_fit_error(const sim_det_point_t *points, int count, uint8_t channel, double scale,
+                              const uint32_t *table)
+{
+    double lower, upper, fitted, target, error, worst = 0.0;
+    uint8_t j;
+    int i;
+
+    for(i = 0; i < count; i++)
+    {
+        if(points[i].channel != channel) { continue; }
+        j = table_weights(detector_output(&points[i]), &lower, &upper);
+        fitted = lower * table[j] + ((upper > 0.0) ? upper * table[j + 1] : 0.0);
+        target = points[i].volts * scale;
+        error = fabs(fitted - target) / target;
+        if(error > worst) { worst = error; }
+    }
+    return worst;
+}
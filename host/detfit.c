@@ -0,0 +1,78 @@
+/*
+ * File: detfit.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Fits the FWD and REF detector linearization tables from a
+ *              calibration file, see detector_fit.c for its format. The tables are
+ *              printed as the initializer of detector_table, with the worst fit
+ *              error of each channel over its points. On the target each entry can
+ *              also be written with set_detector_point().
+ *
+ *              Usage: detfit calibration.txt
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "intellitune.h"
+#include "sim.h"
+
+
+#define MAX_POINTS                  4096
+
+
+int main(int argc, char **argv)
+{
+    static sim_det_point_t points[MAX_POINTS];
+    static const char *const names[2] = { "FWD", "REF" };
+    uint32_t table[2][DET_TABLE_POINTS];
+    int count, used[2];
+    double scale;
+    uint8_t channel, i;
+
+    if(argc != 2)
+    {
+        fprintf(stderr, "usage: %s calibration.txt\n", argv[0]);
+        return 2;
+    }
+    count = sim_read_calibration(argv[1], points, MAX_POINTS);
+    if(count < 0)
+    {
+        fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    scale = sim_detector_scale(points, count);
+    if(scale <= 0.0)
+    {
+        fprintf(stderr, "%s: no FWD points in %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    for(channel = DET_FWD; channel <= DET_REF; channel++)
+    {
+        used[channel] = sim_fit_detector(points, count, channel, scale, table[channel]);
+        if(used[channel] == 0)
+        {
+            fprintf(stderr, "%s: no %s points in %s\n", argv[0], names[channel], argv[1]);
+            return 1;
+        }
+    }
+
+    printf("// Fitted from %s, %d FWD and %d REF points, %.1f units per volt\n", argv[1], used[DET_FWD],
+           used[DET_REF], scale);
+    printf("uint32_t detector_table[2][DET_TABLE_POINTS] = {\n");
+    for(channel = DET_FWD; channel <= DET_REF; channel++)
+    {
+        printf("    { // %s, worst error %.2f %%\n       ", names[channel],
+               100.0 * sim_detector_fit_error(points, count, channel, scale, table[channel]));
+        for(i = 0; i < DET_TABLE_POINTS; i++)
+        {
+            printf(" 0x%lX%s", (unsigned long)table[channel][i], (i + 1 < DET_TABLE_POINTS) ? "," : "");
+            if((i % 8 == 7) && (i + 1 < DET_TABLE_POINTS)) { printf("\n       "); }
+        }
+        printf(" }%s\n", (channel == DET_FWD) ? "," : "");
+    }
+    printf("};\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * File: iqmath_host.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host builds of the IQmath functions the firmware calls, in place of
+ *              the MSP430 library. Multiplies truncate as the library does and
+ *              the rounding multiply rounds, divides saturate, square roots of
+ *              negative numbers are 0 and _IQNtoa() truncates to the digits of its
+ *              "%W.Ff" format, returning 1 if the integer part needs more than W.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "IQmathLib.h"
+
+
+// Function Prototypes
+static int32_t iq_mpy(int32_t a, int32_t b, uint8_t q, uint8_t round);
+static int32_t iq_div(int32_t a, int32_t b, uint8_t q);
+static int16_t iq_toa(char *string, const char *format, int32_t input, uint8_t q);
+
+
+static int32_t iq_mpy(int32_t a, int32_t b, uint8_t q, uint8_t round)
+{
+    int64_t product = (int64_t)a * b;
+
+    if(round) { product += (int64_t)1 << (q - 1); }
+    return (int32_t)(product >> q);
+}
+
+
+static int32_t iq_div(int32_t a, int32_t b, uint8_t q)
+{
+    int64_t quotient;
+
+    if(b == 0) { return (a < 0) ? INT32_MIN : INT32_MAX; }
+    quotient = ((int64_t)a * ((int64_t)1 << q)) / b;
+    if(quotient > INT32_MAX) { return INT32_MAX; }
+    if(quotient < INT32_MIN) { return INT32_MIN; }
+    return (int32_t)quotient;
+}
+
+
+static int16_t iq_toa(char *string, const char *format, int32_t input, uint8_t q)
+{
+    unsigned int width = 0, decimals = 0;
+    uint64_t magnitude = (input < 0) ? (uint64_t)(-(int64_t)input) : (uint64_t)input;
+    uint64_t whole = magnitude >> q, fraction = magnitude & (((uint64_t)1 << q) - 1);
+    char digits[24];
+    unsigned int i;
+
+    if(sscanf(format, "%%%u.%uf", &width, &decimals) != 2) { return 1; }
+    snprintf(digits, sizeof(digits), "%llu", (unsigned long long)whole);
+    if(strlen(digits) > width) { return 1; }
+    if(input < 0) { *string++ = '-'; }
+    strcpy(string, digits);
+    string += strlen(digits);
+    if(decimals)
+    {
+        *string++ = '.';
+        for(i = 0; i < decimals; i++)
+        {
+            fraction *= 10;
+            *string++ = '0' + (char)(fraction >> q);
+            fraction &= ((uint64_t)1 << q) - 1;
+        }
+    }
+    *string = '\0';
+    return 0;
+}
+
+
+_iq16 _IQ16mpy(_iq16 A, _iq16 B) { return iq_mpy(A, B, 16, 0); }
+_iq16 _IQ16rmpy(_iq16 A, _iq16 B) { return iq_mpy(A, B, 16, 1); }
+_iq19 _IQ19mpy(_iq19 A, _iq19 B) { return iq_mpy(A, B, 19, 0); }
+_iq16 _IQ16div(_iq16 A, _iq16 B) { return iq_div(A, B, 16); }
+_iq19 _IQ19div(_iq19 A, _iq19 B) { return iq_div(A, B, 19); }
+int16_t _IQ16toa(char *string, const char *format, _iq16 input) { return iq_toa(string, format, input, 16); }
+int16_t _IQ19toa(char *string, const char *format, _iq19 input) { return iq_toa(string, format, input, 19); }
+
+
+_iq16 _IQ16sqrt(_iq16 A)
+{
+    uint64_t value, root = 0, bit = (uint64_t)1 << 46;
+
+    if(A <= 0) { return 0; }
+    value = (uint64_t)A << 16; // Root of A * 2^32 is the Q16 root
+    while(bit > value) { bit >>= 2; }
+    while(bit)
+    {
+        if(value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (_iq16)root;
+}
+
+
+_iq16 _IQ16frac(_iq16 A)
+{
+    return (A < 0) ? -((-A) & 0xFFFF) : (A & 0xFFFF);
+}
@@ -0,0 +1,266 @@
+/*
+ * File: msp430fr2355.h
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Register shim that lets the firmware sources build on a Linux host.
+ *              It stands in for the TI device header, which is found first on the
+ *              include path when building with host/Makefile.
+ *
+ *              Bit and field constants carry the values of the device header. The
+ *              peripheral registers the firmware uses are plain volatile variables
+ *              defined in sim_core.c, so firmware writes land where the simulator
+ *              can see them and simulator writes (ADCMEM0, the interrupt vector
+ *              registers) are what the firmware reads back.
+ *
+ *              The timer counters and the SPI transmit buffer are the exceptions.
+ *              TBxR is computed from simulated time on every access, and each access
+ *              costs a few CPU cycles of it, so polling loops see the counters move.
+ *              A write to UCB1TXBUF starts a transfer.
+ *
+ *              Interrupts are taken by the simulator between tasks, so the status
+ *              register intrinsics only keep track of GIE and the low power bits.
+ *
+ ******************************************************************************/
+
+#ifndef HOST_MSP430FR2355_H
+#define HOST_MSP430FR2355_H
+
+#include <stdint.h>
+
+
+// Macros for the bits
+#define BIT0                        0x0001
+#define BIT1                        0x0002
+#define BIT2                        0x0004
+#define BIT3                        0x0008
+#define BIT4                        0x0010
+#define BIT5                        0x0020
+#define BIT6                        0x0040
+#define BIT7                        0x0080
+#define BIT8                        0x0100
+#define BIT9                        0x0200
+#define BITA                        0x0400
+#define BITB                        0x0800
+#define BITC                        0x1000
+#define BITD                        0x2000
+#define BITE                        0x4000
+#define BITF                        0x8000
+
+// Macros for the status register
+#define GIE                         0x0008
+#define CPUOFF                      0x0010
+#define OSCOFF                      0x0020
+#define SCG0                        0x0040
+#define SCG1                        0x0080
+#define LPM0_bits                   (CPUOFF)
+#define LPM3_bits                   (SCG1 | SCG0 | CPUOFF)
+
+// Macros for the watchdog, FRAM controller, system and PMM
+#define WDTPW                       0x5A00
+#define WDTHOLD                     0x0080
+#define FRCTLPW                     0xA500
+#define NWAITS_2                    0x0020
+#define FRWPPW                      0xA500
+#define PFWP                        0x0001
+#define DFWP                        0x0002
+#define LOCKLPM5                    0x0001
+#define PMMPW_H                     0xA5
+#define INTREFEN                    0x0001
+#define REFVSEL_0                   0x0000
+#define REFGENRDY                   0x1000
+
+// Macros for the clock system
+#define DCOFFG                      0x0001
+#define XT1OFFG                     0x0002
+#define FLLUNLOCK0                  0x0100
+#define FLLUNLOCK1                  0x0200
+#define OFIFG                       0x0002
+#define DCORSEL_7                   0x000E
+#define FLLD_0                      0x0000
+#define SELREF__XT1CLK              0x0000
+#define SELMS__DCOCLKDIV            0x0000
+#define SELA__XT1CLK                0x0000
+
+// Macros for Timer_B
+#define TBIFG                       0x0001
+#define TBIE                        0x0002
+#define TBCLR                       0x0004
+#define MC_0                        0x0000
+#define MC_1                        0x0010
+#define MC_2                        0x0020
+#define MC_3                        0x0030
+#define MC__STOP                    MC_0
+#define MC__UP                      MC_1
+#define MC__CONTINUOUS              MC_2
+#define MC__UPDOWN                  MC_3
+#define ID_0                        0x0000
+#define ID_1                        0x0040
+#define ID_2                        0x0080
+#define ID_3                        0x00C0
+#define TBSSEL_0                    0x0000
+#define TBSSEL_1                    0x0100
+#define TBSSEL_2                    0x0200
+#define TBSSEL_3                    0x0300
+#define CNTL_0                      0x0000
+#define TBIDEX_0                    0x0000
+#define TBIDEX_1                    0x0001
+#define TBIDEX_2                    0x0002
+#define TBIDEX_3                    0x0003
+#define TBIDEX_4                    0x0004
+#define TBIDEX_5                    0x0005
+#define TBIDEX_6                    0x0006
+#define TBIDEX_7                    0x0007
+#define CCIFG                       0x0001
+#define CCIE                        0x0010
+#define CCIE_0                      0x0000
+#define TBIV_NONE                   0x0000
+#define TBIV_2                      0x0002
+#define TBIV_4                      0x0004
+#define TBIV_6                      0x0006
+#define TBIV_8                      0x0008
+#define TBIV_10                     0x000A
+#define TBIV_12                     0x000C
+#define TBIV_14                     0x000E
+
+// Macros for the ADC
+#define ADCSC                       0x0001
+#define ADCENC                      0x0002
+#define ADCON                       0x0010
+#define ADCMSC                      0x0080
+#define ADCSHT                      0x0F00
+#define ADCSHT_0                    0x0000
+#define ADCSHT_4                    0x0400
+#define ADCSHT_8                    0x0800
+#define ADCBUSY                     0x0001
+#define ADCCONSEQ                   0x0006
+#define ADCCONSEQ_0                 0x0000
+#define ADCCONSEQ_1                 0x0002
+#define ADCCONSEQ_2                 0x0004
+#define ADCCONSEQ_3                 0x0006
+#define ADCSSEL                     0x0018
+#define ADCSSEL_0                   0x0000
+#define ADCSSEL_1                   0x0008
+#define ADCSSEL_2                   0x0010
+#define ADCSSEL_3                   0x0018
+#define ADCDIV                      0x00E0
+#define ADCDIV_0                    0x0000
+#define ADCDIV_4                    0x0080
+#define ADCSHP                      0x0200
+#define ADCRES                      0x0030
+#define ADCRES_0                    0x0000
+#define ADCRES_1                    0x0010
+#define ADCRES_2                    0x0020
+#define ADCINCH                     0x000F
+#define ADCINCH_0                   0x0000
+#define ADCINCH_8                   0x0008
+#define ADCINCH_9                   0x0009
+#define ADCINCH_10                  0x000A
+#define ADCINCH_11                  0x000B
+#define ADCSREF_1                   0x0010
+#define ADCIE0                      0x0001
+#define ADCINIE                     0x0002
+#define ADCLOIE                     0x0004
+#define ADCHIIE                     0x0008
+#define ADCOVIE                     0x0010
+#define ADCTOVIE                    0x0020
+#define ADCIFG0                     0x0001
+#define ADCINIFG                    0x0002
+#define ADCLOIFG                    0x0004
+#define ADCHIIFG                    0x0008
+#define ADCOVIFG                    0x0010
+#define ADCTOVIFG                   0x0020
+#define ADCIV_NONE                  0x0000
+#define ADCIV_ADCOVIFG              0x0002
+#define ADCIV_ADCTOVIFG             0x0004
+#define ADCIV_ADCHIIFG              0x0006
+#define ADCIV_ADCLOIFG              0x0008
+#define ADCIV_ADCINIFG              0x000A
+#define ADCIV_ADCIFG                0x000C
+
+// Macros for eUSCI_B in SPI mode
+#define UCSWRST                     0x0001
+#define UCSSEL__SMCLK               0x0080
+#define UCSYNC                      0x0100
+#define UCMODE_0                    0x0000
+#define UCMST                       0x0800
+#define UCMSB                       0x2000
+#define UCCKPH                      0x8000
+#define UCLISTEN                    0x0080
+#define UCRXIE                      0x0001
+#define UCTXIE                      0x0002
+#define UCRXIFG                     0x0001
+#define UCTXIFG                     0x0002
+#define USCI_NONE                   0x0000
+#define USCI_SPI_UCRXIFG            0x0002
+#define USCI_SPI_UCTXIFG            0x0004
+
+// Macros for the port interrupt vectors
+#define P1IV_2                      0x0002
+#define P2IV_2                      0x0002
+#define P2IV_4                      0x0004
+#define P2IV_6                      0x0006
+#define P2IV_8                      0x0008
+#define P2IV_10                     0x000A
+#define P2IV_12                     0x000C
+#define P2IV_14                     0x000E
+#define P2IV_16                     0x0010
+#define P3IV_2                      0x0002
+#define P3IV_4                      0x0004
+#define P3IV_12                     0x000C
+#define P4IV_2                      0x0002
+
+
+// Intrinsics. Interrupts are dispatched by the simulator, so these only keep the
+// status register bits for the simulator to inspect.
+extern volatile uint16_t sim_sr;
+extern void sim_delay_cycles(uint32_t cycles);
+#define __interrupt
+#define __even_in_range(x, y)       (x)
+#define __bis_SR_register(x)        (sim_sr |= (x))
+#define __bic_SR_register(x)        (sim_sr &= ~(x))
+#define __bis_SR_register_on_exit(x) (sim_sr |= (x))
+#define __bic_SR_register_on_exit(x) (sim_sr &= ~(x))
+#define __get_SR_register()         (sim_sr)
+#define __delay_cycles(x)           sim_delay_cycles(x)
+#define __no_operation()            ((void)0)
+#define __disable_interrupt()       (sim_sr &= ~GIE)
+#define __enable_interrupt()        (sim_sr |= GIE)
+
+
+// Timer counters and the SPI transmit buffer go through the simulator
+extern volatile uint16_t *sim_timer_count(uint8_t timer);
+extern volatile uint16_t *sim_spi_txbuf(void);
+#define TB0R                        (*sim_timer_count(0))
+#define TB1R                        (*sim_timer_count(1))
+#define TB2R                        (*sim_timer_count(2))
+#define TB3R                        (*sim_timer_count(3))
+#define UCB1TXBUF                   (*sim_spi_txbuf())
+
+
+// Registers
+extern volatile uint16_t WDTCTL, FRCTL0, SYSCFG0, PM5CTL0, SFRIFG1, PMMCTL2;
+extern volatile uint8_t PMMCTL0_H;
+extern volatile uint16_t CSCTL0, CSCTL1, CSCTL2, CSCTL3, CSCTL4, CSCTL7;
+
+extern volatile uint8_t P1DIR, P1OUT, P1IN, P1REN, P1SEL0, P1SEL1, P1IE, P1IES, P1IFG;
+extern volatile uint8_t P2DIR, P2OUT, P2IN, P2REN, P2SEL0, P2SEL1, P2IE, P2IES, P2IFG;
+extern volatile uint8_t P3DIR, P3OUT, P3IN, P3REN, P3SEL0, P3SEL1, P3IE, P3IES, P3IFG;
+extern volatile uint8_t P4DIR, P4OUT, P4IN, P4REN, P4SEL0, P4SEL1, P4IE, P4IES, P4IFG;
+extern volatile uint8_t P5DIR, P5OUT, P5IN, P5REN, P5SEL0, P5SEL1;
+extern volatile uint8_t P6DIR, P6OUT, P6IN, P6REN, P6SEL0, P6SEL1;
+extern volatile uint8_t P7DIR, P7OUT, P8DIR, P8OUT, P9DIR, P9OUT, P10DIR, P10OUT;
+extern volatile uint16_t P1IV, P2IV, P3IV, P4IV;
+extern volatile uint16_t PADIR, PAOUT, PBDIR, PBOUT, PCDIR, PCOUT, PDDIR, PDOUT, PEDIR, PEOUT;
+
+extern volatile uint16_t TB0CTL, TB0CCTL0, TB0CCTL1, TB0CCTL2, TB0CCR0, TB0CCR1, TB0CCR2, TB0IV, TB0EX0;
+extern volatile uint16_t TB1CTL, TB1CCTL0, TB1CCTL1, TB1CCTL2, TB1CCR0, TB1CCR1, TB1CCR2, TB1IV, TB1EX0;
+extern volatile uint16_t TB2CTL, TB2CCTL0, TB2CCTL1, TB2CCTL2, TB2CCR0, TB2CCR1, TB2CCR2, TB2IV, TB2EX0;
+extern volatile uint16_t TB3CTL, TB3CCTL0, TB3CCTL1, TB3CCTL2, TB3CCTL3, TB3CCTL4, TB3CCTL5, TB3CCTL6,
+                         TB3CCR0, TB3CCR1, TB3CCR2, TB3CCR3, TB3CCR4, TB3CCR5, TB3CCR6, TB3IV, TB3EX0;
+
+extern volatile uint16_t ADCCTL0, ADCCTL1, ADCCTL2, ADCMCTL0, ADCMEM0, ADCIE, ADCIFG, ADCIV, ADCHI, ADCLO;
+
+extern volatile uint16_t UCB1CTLW0, UCB1BRW, UCB1STATW, UCB1RXBUF, UCB1IE, UCB1IFG, UCB1IV;
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * File: sim.h
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host simulator of the Intellitune hardware. The firmware sources
+ *              are compiled unmodified against the register shim and run against
+ *              models of the timers, ADC, SPI digipot, stepper motors with their
+ *              position pots, relays, L-network, SWR bridge and antenna.
+ *
+ *              sim_core.c holds the peripherals and the event loop, sim_physics.c
+ *              the RF models. Time is simulated, so a tune that takes seconds on the
+ *              bench runs in a fraction of that.
+ *
+ ******************************************************************************/
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <complex.h>
+
+
+// Macros for the simulated clocks
+#define SIM_SMCLK_HZ                24000000.0
+#define SIM_ACLK_HZ                 32768.0
+#define SIM_MODOSC_HZ               4800000.0
+#define SIM_REG_READ_CYCLES         4   // MCLK cycles charged for each timer counter read
+#define SIM_ISR_CYCLES              40  // MCLK cycles charged for each interrupt entry and exit
+// Macros for the hardware models
+#define SIM_ADC_VREF                1.5 // Volts
+#define SIM_ADC_FULL_SCALE          4095
+#define SIM_ADC_CHANNELS            16
+#define SIM_POT_COUNTS              4095.0 // Pot travel in ADC counts
+#define SIM_CAP_PF_PER_COUNT        (500.0 / 4085.0) // Varicap, 30 pF at 245 counts
+#define SIM_RELAY_PF                470.0 // Each step of the binary capacitor relays
+#define SIM_IND_UH_PER_COUNT        (24.0 / 4085.0) // Roller inductor
+#define SIM_CAP_COUNTS_PER_STEP     (4085.0 / 5373.0) // Varicap motor, with MS1 half steps
+#define SIM_IND_COUNTS_PER_STEP     (4085.0 / 6200.0) // Roller inductor motor
+#define SIM_KNOWN_OHMS              25.0 // Series resistor switched in by P3.6
+#define SIM_Z0                      50.0
+#define SIM_INDUCTOR_Q              150.0
+#define SIM_DETECTOR_V_PER_SQRT_W   0.2 // Detector volts per root watt of forward power
+#define SIM_VSWR_OPEN               99.0 // Reported for a total reflection
+// Macros for the load models
+#define SIM_LOAD_FIXED              0   // R + jX at any frequency
+#define SIM_LOAD_DIPOLE             1   // Center fed thin wire dipole
+#define SIM_LOAD_MONOPOLE           2   // Vertical over ground, with ground loss
+#define SIM_LOAD_TABLE              3   // Measured points, see touchstone.c
+#define SIM_LOAD_NAME_LEN           32
+
+
+// Types
+typedef struct
+{
+    char name[SIM_LOAD_NAME_LEN];
+    uint8_t model;              // SIM_LOAD_FIXED, ...
+    double r, x;                // Fixed load, ohms
+    double length, radius;      // Dipole length or monopole height and wire radius, meters
+    double loss;                // Series loss resistance, ohms
+    const double *table_hz;     // SIM_LOAD_TABLE points, ascending frequency
+    const double complex *table_z;
+    uint16_t table_points;
+} sim_load_t;
+
+typedef struct
+{
+    uint8_t channel;            // DET_FWD or DET_REF
+    uint8_t gain_code;          // Digipot code the reading was taken at
+    uint16_t reading;           // Published FWD or REF reading, ADC_HIRES scale
+    double volts;               // True RF voltage, any unit both channels share
+} sim_det_point_t;
+
+typedef struct
+{
+    double freq_hz;             // Carrier frequency
+    double power_w;             // Forward power
+    uint8_t keyed;              // Carrier on
+} sim_carrier_t;
+
+typedef struct
+{
+    double noise_pot;           // Pot reading noise, ADC counts rms
+    double noise_detector;      // FWD/REF reading noise, ADC counts rms
+    double cap_pot_offset;      // Pot reading error at the start of the run, ADC counts
+    double ind_pot_offset;
+    uint32_t seed;              // Noise generator seed
+} sim_options_t;
+
+typedef struct
+{
+    double cap_position;        // Varicap pot, ADC counts
+    double ind_position;        // Inductor pot, ADC counts
+    uint32_t cap_steps;         // Step pulses seen at the drivers
+    uint32_t ind_steps;
+    uint8_t relays;             // Capacitor relay setting from P1.5 - P1.7
+    uint8_t cap_input_side;     // P3.4
+    uint8_t known_in;           // P3.6, known impedance switched in
+    uint8_t wiper;              // Code on the digipot wiper
+} sim_hw_t;
+
+
+// Globals
+extern double sim_now;          // Simulated time, seconds
+extern sim_carrier_t sim_carrier;
+extern sim_options_t sim_options;
+extern sim_hw_t sim_hw;
+extern uint32_t sim_adc_conversions[SIM_ADC_CHANNELS];
+
+
+// Simulator core, sim_core.c
+extern void sim_reset(const sim_options_t *options);
+extern void sim_power_up(void);
+extern void sim_run(double seconds);
+extern uint8_t sim_run_until(uint8_t (*done)(void), double timeout);
+extern void sim_key(double freq_hz, double power_w);
+extern void sim_unkey(void);
+extern void sim_set_load(const sim_load_t *load);
+extern void sim_press_tune(void);
+extern void sim_set_positions(double cap_position, double ind_position);
+extern double sim_gauss(void);
+
+// RF models, sim_physics.c
+extern double complex sim_load_impedance(const sim_load_t *load, double freq_hz);
+extern double complex sim_network_impedance(double freq_hz, double complex z_load, const sim_hw_t *hw);
+extern double sim_reflection(double complex z, double z0);
+extern double sim_vswr(double gamma);
+extern double sim_capacitance_pf(const sim_hw_t *hw);
+extern double sim_inductance_uh(const sim_hw_t *hw);
+extern void sim_detectors(double freq_hz, double power_w, double complex z_load, const sim_hw_t *hw,
+                          double *fwd_volts, double *ref_volts);
+extern double sim_matched_vswr(double freq_hz, double complex z_load, const sim_hw_t *hw);
+
+// Load corpus, sim_physics.c, and measured loads, touchstone.c
+extern int sim_load_corpus(const char *path, sim_load_t *loads, double *freq_hz, int max_loads);
+extern int sim_load_touchstone(const char *path, sim_load_t *load);
+
+// Detector linearization fit, detector_fit.c. Tables have DET_TABLE_POINTS entries.
+extern int sim_read_calibration(const char *path, sim_det_point_t *points, int max_points);
+extern double sim_detector_scale(const sim_det_point_t *points, int count);
+extern int sim_fit_detector(const sim_det_point_t *points, int count, uint8_t channel, double scale, uint32_t *table);
+extern double sim_detector_fit_error(const sim_det_point_t *points, int count, uint8_t channel, double scale,
+                                     const uint32_t *table);
+
+#endif
@@ -0,0 +1,722 @@
+/*
+ * File: sim_core.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Peripheral models and event loop of the host simulator.
+ *
+ *              Registers are the plain variables declared in the register shim. The
+ *              four Timer_B counters are computed from simulated time with the clock
+ *              source, dividers and mode taken from TBxCTL and TBxEX0, and a firmware
+ *              write to TBxR or TBCLR restarts the count. Timer1 counts the carrier
+ *              from its external input. Compare channels with CCIE set and counters
+ *              with TBIE set raise their interrupts when the count gets there.
+ *
+ *              The ADC converts single channels or sequences from ADCMCTL0 down to
+ *              A0 with the sample and conversion time of its clock settings, sets
+ *              the window comparator flags against ADCHI and ADCLO, and stops at
+ *              once when a sequence is ended with ADCCONSEQ and ADCENC cleared.
+ *              eUSCI_B1 shifts each byte written to UCB1TXBUF at SMCLK / UCB1BRW and
+ *              loops it back. The digipot on it takes the second byte of a command
+ *              as its wiper code while P4.4 is low.
+ *
+ *              Step pulses on P1.1 and P1.3 move the pots while the driver enables
+ *              (P5.4, P3.2) are low, in the direction of P1.4 and P2.4. Relays and
+ *              the known impedance follow their port pins.
+ *
+ *              Interrupt service routines run between tasks and never preempt one,
+ *              so sections the firmware guards with GIE are atomic here as well.
+ *              tests/test_adc_ring.c preempts the ADC ring's consumer separately.
+ *              Tasks and interrupts take no simulated time apart from the cycles
+ *              charged for each timer counter read and interrupt entry.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "intellitune.h"
+#include "sim.h"
+
+
+// Interrupt service routines and initialization of the firmware under test
+extern void init_gpio(void);
+extern void ADC_ISR(void);
+extern void Timer0_B1(void);
+extern void Timer1_B0(void);
+extern void Timer2_B1(void);
+extern void Timer3_B1(void);
+extern void USCI_B1_ISR(void);
+extern void Port_2(void);
+extern void Port_3(void);
+extern void Port_4(void);
+
+
+// Function Prototypes
+static double timer_rate(uint8_t index);
+static uint64_t timer_counts(uint8_t index, double when);
+static void timer_rebase(uint8_t index);
+static void timer_sync(uint8_t index);
+static double timer_time_of(uint8_t index, uint64_t count);
+static void dispatch(void (*isr)(void));
+static double adc_conversion_time(void);
+static uint16_t adc_sample(uint8_t channel);
+static void adc_service(void);
+static void adc_complete(void);
+static void spi_service(void);
+static void spi_complete(void);
+static void motor_service(void);
+static void sim_service(void);
+static void run_tasks(void);
+static uint8_t step_event(double end);
+
+
+// Registers
+volatile uint16_t sim_sr = 0;
+volatile uint16_t WDTCTL, FRCTL0, SYSCFG0, PM5CTL0, SFRIFG1, PMMCTL2;
+volatile uint8_t PMMCTL0_H;
+volatile uint16_t CSCTL0, CSCTL1, CSCTL2, CSCTL3, CSCTL4, CSCTL7;
+volatile uint8_t P1DIR, P1OUT, P1IN, P1REN, P1SEL0, P1SEL1, P1IE, P1IES, P1IFG;
+volatile uint8_t P2DIR, P2OUT, P2IN, P2REN, P2SEL0, P2SEL1, P2IE, P2IES, P2IFG;
+volatile uint8_t P3DIR, P3OUT, P3IN, P3REN, P3SEL0, P3SEL1, P3IE, P3IES, P3IFG;
+volatile uint8_t P4DIR, P4OUT, P4IN, P4REN, P4SEL0, P4SEL1, P4IE, P4IES, P4IFG;
+volatile uint8_t P5DIR, P5OUT, P5IN, P5REN, P5SEL0, P5SEL1;
+volatile uint8_t P6DIR, P6OUT, P6IN, P6REN, P6SEL0, P6SEL1;
+volatile uint8_t P7DIR, P7OUT, P8DIR, P8OUT, P9DIR, P9OUT, P10DIR, P10OUT;
+volatile uint16_t P1IV, P2IV, P3IV, P4IV;
+volatile uint16_t PADIR, PAOUT, PBDIR, PBOUT, PCDIR, PCOUT, PDDIR, PDOUT, PEDIR, PEOUT;
+volatile uint16_t TB0CTL, TB0CCTL0, TB0CCTL1, TB0CCTL2, TB0CCR0, TB0CCR1, TB0CCR2, TB0IV, TB0EX0;
+volatile uint16_t TB1CTL, TB1CCTL0, TB1CCTL1, TB1CCTL2, TB1CCR0, TB1CCR1, TB1CCR2, TB1IV, TB1EX0;
+volatile uint16_t TB2CTL, TB2CCTL0, TB2CCTL1, TB2CCTL2, TB2CCR0, TB2CCR1, TB2CCR2, TB2IV, TB2EX0;
+volatile uint16_t TB3CTL, TB3CCTL0, TB3CCTL1, TB3CCTL2, TB3CCTL3, TB3CCTL4, TB3CCTL5, TB3CCTL6,
+                  TB3CCR0, TB3CCR1, TB3CCR2, TB3CCR3, TB3CCR4, TB3CCR5, TB3CCR6, TB3IV, TB3EX0;
+volatile uint16_t ADCCTL0, ADCCTL1, ADCCTL2, ADCMCTL0, ADCMEM0, ADCIE, ADCIFG, ADCIV, ADCHI, ADCLO;
+volatile uint16_t UCB1CTLW0, UCB1BRW, UCB1STATW, UCB1RXBUF, UCB1IE, UCB1IFG, UCB1IV;
+
+
+// Macros for the event loop
+#define SIM_EVENT_NONE              0
+#define SIM_EVENT_COMPARE           1
+#define SIM_EVENT_OVERFLOW          2
+#define SIM_EVENT_ADC               3
+#define SIM_EVENT_SPI               4
+#define SIM_TIMERS                  4
+#define SIM_CHANNELS                7
+#define SIM_TICK_MARGIN             0.001 // Fraction of a tick events are placed after their count
+
+
+// Types
+typedef struct
+{
+    volatile uint16_t *ctl, *ex0, *iv;
+    volatile uint16_t *ccr[SIM_CHANNELS], *cctl[SIM_CHANNELS];
+    void (*vector0)(void);      // CCR0 interrupt
+    void (*vector1)(void);      // Other compare channels and overflow
+    uint16_t r, r_seen;         // Counter behind TBxR and its value when last published
+    uint16_t ctl_seen, ex0_seen;
+    double t0, rate;            // Time of the last restart and counts per second since
+    uint64_t count0;            // Count at t0, not wrapped
+    uint64_t overflows_flagged, overflows_served;
+    uint16_t ccr_seen[SIM_CHANNELS];
+    uint8_t armed[SIM_CHANNELS];
+    uint64_t target[SIM_CHANNELS]; // Count the next compare interrupt is due at
+} sim_timer_t;
+
+
+// Globals
+double sim_now = 0.0;
+sim_carrier_t sim_carrier = {0};
+sim_options_t sim_options = {0};
+sim_hw_t sim_hw = {0};
+uint32_t sim_adc_conversions[SIM_ADC_CHANNELS]; // Conversions finished on each channel
+static sim_timer_t timers[SIM_TIMERS];
+static const sim_load_t *sim_load = NULL;
+static double complex load_z = SIM_Z0;
+static double load_z_freq = -1.0; // Carrier frequency load_z was found for
+static uint64_t rng_state = 1;
+static uint8_t last_p1 = 0;
+static struct
+{
+    uint8_t busy, channel, sequence;
+    double done;
+} adc;
+static struct
+{
+    uint8_t busy, pending, written, shift, frame_bytes, command;
+    uint16_t txbuf;
+    double done;
+} spi;
+static const uint16_t sht_cycles[16] = { 4, 8, 16, 32, 64, 96, 128, 192, 256, 384, 512, 768,
+                                         1024, 1024, 1024, 1024 };
+
+
+// Normally distributed noise with unit variance, from a xorshift generator.
+double sim_gauss(void)
+{
+    double u1, u2;
+
+    do {
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        u1 = (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        u2 = (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+    } while(u1 <= 0.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+// Counts per second of a timer from its clock source, dividers and mode.
+static double timer_rate(uint8_t index)
+{
+    sim_timer_t *timer = &timers[index];
+    uint16_t ctl = *timer->ctl;
+    double clock;
+
+    if((ctl & MC_3) == MC_0) { return 0.0; }
+    switch(ctl & TBSSEL_3)
+    {
+    case TBSSEL_0: // TBxCLK, only Timer1 has an input connected
+        clock = ((index == 1) && sim_carrier.keyed) ? sim_carrier.freq_hz : 0.0;
+        break;
+    case TBSSEL_1:
+        clock = SIM_ACLK_HZ;
+        break;
+    case TBSSEL_2:
+        clock = SIM_SMCLK_HZ;
+        break;
+    default:
+        clock = 0.0;
+        break;
+    }
+    return clock / (1 << ((ctl & ID_3) >> 6)) / ((*timer->ex0 & TBIDEX_7) + 1);
+}
+
+
+// Count of a timer at the given time, not wrapped to 16 bits.
+static uint64_t timer_counts(uint8_t index, double when)
+{
+    sim_timer_t *timer = &timers[index];
+
+    if((timer->rate <= 0.0) || (when <= timer->t0)) { return timer->count0; }
+    return timer->count0 + (uint64_t)floor((when - timer->t0) * timer->rate);
+}
+
+
+// Time at which a timer reaches the given count.
+static double timer_time_of(uint8_t index, uint64_t count)
+{
+    sim_timer_t *timer = &timers[index];
+
+    return timer->t0 + ((double)(count - timer->count0) + SIM_TICK_MARGIN) / timer->rate;
+}
+
+
+// Carry the count to now at the old rate and continue at the current settings.
+static void timer_rebase(uint8_t index)
+{
+    sim_timer_t *timer = &timers[index];
+
+    timer->count0 = timer_counts(index, sim_now);
+    timer->t0 = sim_now;
+    timer->rate = timer_rate(index);
+}
+
+
+// Pick up firmware writes to a timer and publish its count in TBxR.
+static void timer_sync(uint8_t index)
+{
+    sim_timer_t *timer = &timers[index];
+    uint64_t count;
+    uint16_t ctl;
+    uint8_t channel, restart = 0;
+
+    if(timer->r != timer->r_seen) { // TBxR written
+        timer->count0 = timer->r;
+        timer->t0 = sim_now;
+        restart = 1;
+    }
+    if(*timer->ctl & TBCLR) {
+        *timer->ctl &= ~TBCLR;
+        timer->count0 = 0;
+        timer->t0 = sim_now;
+        restart = 1;
+    }
+    if(restart) {
+        timer->overflows_flagged = 0;
+        timer->overflows_served = 0;
+        memset(timer->armed, 0, sizeof(timer->armed));
+    }
+    ctl = *timer->ctl & ~TBIFG;
+    if((ctl != timer->ctl_seen) || (*timer->ex0 != timer->ex0_seen)) {
+        timer_rebase(index);
+        timer->ctl_seen = ctl;
+        timer->ex0_seen = *timer->ex0;
+    }
+
+    count = timer_counts(index, sim_now);
+    if((count >> 16) > timer->overflows_flagged) {
+        timer->overflows_flagged = count >> 16;
+        *timer->ctl |= TBIFG;
+    }
+    if(!(*timer->ctl & TBIE)) { timer->overflows_served = timer->overflows_flagged; }
+    timer->r = timer->r_seen = (uint16_t)count;
+
+    // A compare channel is due when the count next reaches its CCR
+    for(channel = 0; channel < SIM_CHANNELS; channel++)
+    {
+        if((timer->cctl[channel] == NULL) || !(*timer->cctl[channel] & CCIE)) {
+            if(timer->cctl[channel] != NULL) { timer->armed[channel] = 0; }
+            continue;
+        }
+        if(timer->armed[channel] && (*timer->ccr[channel] == timer->ccr_seen[channel])) { continue; }
+        timer->armed[channel] = 1;
+        timer->ccr_seen[channel] = *timer->ccr[channel];
+        timer->target[channel] = count + (((uint16_t)(*timer->ccr[channel] - (uint16_t)count) - 1) & 0xFFFF) + 1;
+    }
+}
+
+
+// Firmware access to TBxR. Each access costs a few cycles of simulated time.
+volatile uint16_t *sim_timer_count(uint8_t timer)
+{
+    sim_now += SIM_REG_READ_CYCLES / SIM_SMCLK_HZ;
+    timer_sync(timer);
+    return &timers[timer].r;
+}
+
+
+// Firmware access to UCB1TXBUF, the shim only writes it.
+volatile uint16_t *sim_spi_txbuf(void)
+{
+    spi.written = 1;
+    return (volatile uint16_t *)&spi.txbuf;
+}
+
+
+// __delay_cycles() on MCLK.
+void sim_delay_cycles(uint32_t cycles)
+{
+    sim_now += cycles / SIM_SMCLK_HZ;
+}
+
+
+// Run an interrupt service routine with interrupts disabled, as on entry.
+static void dispatch(void (*isr)(void))
+{
+    uint16_t saved = sim_sr;
+
+    sim_now += SIM_ISR_CYCLES / SIM_SMCLK_HZ;
+    sim_sr &= ~(GIE | LPM0_bits);
+    isr();
+    sim_sr = saved;
+    sim_service();
+}
+
+
+// Time of one conversion from the ADC clock, sample time and resolution.
+static double adc_conversion_time(void)
+{
+    double clock;
+    uint16_t cycles;
+
+    switch(ADCCTL1 & ADCSSEL)
+    {
+    case ADCSSEL_0:
+        clock = SIM_MODOSC_HZ;
+        break;
+    case ADCSSEL_1:
+        clock = SIM_ACLK_HZ;
+        break;
+    default:
+        clock = SIM_SMCLK_HZ;
+        break;
+    }
+    clock /= ((ADCCTL1 & ADCDIV) >> 5) + 1;
+    cycles = sht_cycles[(ADCCTL0 & ADCSHT) >> 8] + 10 + 2 * ((ADCCTL2 & ADCRES) >> 4);
+    return cycles / clock;
+}
+
+
+// Convert a voltage or pot position on a channel to an ADC result.
+static uint16_t adc_sample(uint8_t channel)
+{
+    double fwd, ref, value = 0.0, gain = (256.0 - sim_hw.wiper) / 256.0;
+
+    switch(channel)
+    {
+    case CAP_PIN:
+        value = sim_hw.cap_position + sim_options.cap_pot_offset + sim_options.noise_pot * sim_gauss();
+        break;
+    case IND_PIN:
+        value = sim_hw.ind_position + sim_options.ind_pot_offset + sim_options.noise_pot * sim_gauss();
+        break;
+    case FWD_PIN:
+    case REF_PIN:
+        fwd = ref = 0.0;
+        if(sim_carrier.keyed && (sim_load != NULL))
+        {
+            if(load_z_freq != sim_carrier.freq_hz) {
+                load_z = sim_load_impedance(sim_load, sim_carrier.freq_hz);
+                load_z_freq = sim_carrier.freq_hz;
+            }
+            sim_detectors(sim_carrier.freq_hz, sim_carrier.power_w, load_z, &sim_hw, &fwd, &ref);
+        }
+        value = ((channel == FWD_PIN) ? fwd : ref) * gain * SIM_ADC_FULL_SCALE / SIM_ADC_VREF;
+        value += sim_options.noise_detector * sim_gauss();
+        break;
+    }
+    if(value < 0.0) { return 0; }
+    if(value > SIM_ADC_FULL_SCALE) { return SIM_ADC_FULL_SCALE; }
+    return (uint16_t)(value + 0.5);
+}
+
+
+// Start a conversion or sequence requested with ADCSC, or drop a sequence that
+// the firmware stopped.
+static void adc_service(void)
+{
+    if(adc.busy && adc.sequence && !(ADCCTL0 & ADCENC) && !(ADCCTL1 & ADCCONSEQ)) { adc.busy = 0; }
+    if(!adc.busy && (ADCCTL0 & ADCON) && (ADCCTL0 & ADCENC) && (ADCCTL0 & ADCSC))
+    {
+        ADCCTL0 &= ~ADCSC;
+        adc.channel = ADCMCTL0 & ADCINCH;
+        adc.sequence = ((ADCCTL1 & ADCCONSEQ) == ADCCONSEQ_1);
+        adc.done = sim_now + adc_conversion_time();
+        adc.busy = 1;
+    }
+}
+
+
+// Finish a conversion, start the next one of a sequence and run the interrupts
+// it raised in ADCIV priority order.
+static void adc_complete(void)
+{
+    static const uint16_t flags[6] = { ADCOVIFG, ADCTOVIFG, ADCHIIFG, ADCLOIFG, ADCINIFG, ADCIFG0 };
+    static const uint16_t vectors[6] = { ADCIV_ADCOVIFG, ADCIV_ADCTOVIFG, ADCIV_ADCHIIFG,
+                                         ADCIV_ADCLOIFG, ADCIV_ADCINIFG, ADCIV_ADCIFG };
+    uint16_t result = adc_sample(adc.channel), pending;
+    uint8_t i;
+
+    sim_adc_conversions[adc.channel]++;
+    ADCMEM0 = result;
+    ADCIFG |= ADCIFG0;
+    if(result > ADCHI) { ADCIFG |= ADCHIIFG; }
+    else if(result < ADCLO) { ADCIFG |= ADCLOIFG; }
+    else { ADCIFG |= ADCINIFG; }
+
+    if(adc.sequence && (ADCCTL0 & ADCENC) && (ADCCTL0 & ADCMSC) && (adc.channel > 0)) {
+        adc.channel--;
+        adc.done = sim_now + adc_conversion_time();
+    } else {
+        adc.busy = 0;
+    }
+
+    while((pending = ADCIFG & ADCIE) != 0)
+    {
+        for(i = 0; !(pending & flags[i]); i++) {}
+        ADCIFG &= ~flags[i];
+        ADCIV = vectors[i];
+        dispatch(ADC_ISR);
+    }
+}
+
+
+// Start a byte written to the transmit buffer once the shifter is free.
+static void spi_service(void)
+{
+    if(!spi.written || (UCB1CTLW0 & UCSWRST)) { return; }
+    spi.written = 0;
+    if(spi.busy) {
+        spi.pending = 1;
+        return;
+    }
+    spi.shift = (uint8_t)spi.txbuf;
+    spi.done = sim_now + 8.0 * (UCB1BRW ? UCB1BRW : 1) / SIM_SMCLK_HZ;
+    spi.busy = 1;
+}
+
+
+// A byte has been shifted out. The digipot takes a command and then a data byte
+// while selected.
+static void spi_complete(void)
+{
+    if(P4OUT & BIT4) {
+        spi.frame_bytes = 0;
+    } else {
+        if(!(spi.frame_bytes & 1)) { spi.command = spi.shift; }
+        else if(((spi.command & 0x30) == 0x10) && (spi.command & 0x03)) { sim_hw.wiper = spi.shift; }
+        spi.frame_bytes++;
+    }
+    UCB1RXBUF = spi.shift; // Looped back
+    if(spi.pending) {
+        spi.pending = 0;
+        spi.shift = (uint8_t)spi.txbuf;
+        spi.done = sim_now + 8.0 * (UCB1BRW ? UCB1BRW : 1) / SIM_SMCLK_HZ;
+    } else {
+        spi.busy = 0;
+    }
+    UCB1IFG |= UCRXIFG | UCTXIFG;
+    if(UCB1IE & UCRXIE)
+    {
+        UCB1IFG &= ~UCRXIFG;
+        UCB1IV = USCI_SPI_UCRXIFG;
+        dispatch(USCI_B1_ISR);
+    }
+}
+
+
+// Move the pots on each rising step edge of an enabled driver.
+static void motor_service(void)
+{
+    uint8_t p1 = P1OUT;
+
+    if((p1 & BIT1) && !(last_p1 & BIT1) && !(P5OUT & BIT4))
+    {
+        sim_hw.cap_position += (P1OUT & BIT4) ? -SIM_CAP_COUNTS_PER_STEP : SIM_CAP_COUNTS_PER_STEP;
+        if(sim_hw.cap_position < 0.0) { sim_hw.cap_position = 0.0; }
+        if(sim_hw.cap_position > SIM_POT_COUNTS) { sim_hw.cap_position = SIM_POT_COUNTS; }
+        sim_hw.cap_steps++;
+    }
+    if((p1 & BIT3) && !(last_p1 & BIT3) && !(P3OUT & BIT2))
+    {
+        sim_hw.ind_position += (P2OUT & BIT4) ? -SIM_IND_COUNTS_PER_STEP : SIM_IND_COUNTS_PER_STEP;
+        if(sim_hw.ind_position < 0.0) { sim_hw.ind_position = 0.0; }
+        if(sim_hw.ind_position > SIM_POT_COUNTS) { sim_hw.ind_position = SIM_POT_COUNTS; }
+        sim_hw.ind_steps++;
+    }
+    last_p1 = p1;
+    sim_hw.relays = (P1OUT >> 5) & 0x07;
+    sim_hw.cap_input_side = (P3OUT & BIT4) ? 1 : 0;
+    sim_hw.known_in = (P3OUT & BIT6) ? 1 : 0;
+}
+
+
+// Bring every model up to date with the registers.
+static void sim_service(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < SIM_TIMERS; i++) { timer_sync(i); }
+    motor_service();
+    adc_service();
+    spi_service();
+}
+
+
+// Run the firmware task loop until every flagged task has run.
+static void run_tasks(void)
+{
+    while(task_flag & (A_TASK | B_TASK | C_TASK))
+    {
+        (*Alpha_State_Ptr)();
+        sim_service();
+    }
+}
+
+
+// Find the next event and handle it if it is due by end. Returns 0 if it is not.
+static uint8_t step_event(double end)
+{
+    double when = end, t;
+    uint8_t kind = SIM_EVENT_NONE, index = 0, channel = 0, i, c;
+    sim_timer_t *timer;
+
+    sim_service();
+    for(i = 0; i < SIM_TIMERS; i++)
+    {
+        timer = &timers[i];
+        if(timer->rate <= 0.0) { continue; }
+        for(c = 0; c < SIM_CHANNELS; c++)
+        {
+            if(!timer->armed[c]) { continue; }
+            t = timer_time_of(i, timer->target[c]);
+            if(t < when) { when = t; kind = SIM_EVENT_COMPARE; index = i; channel = c; }
+        }
+        if(*timer->ctl & TBIE)
+        {
+            t = timer_time_of(i, (timer->overflows_served + 1) << 16);
+            if(t < when) { when = t; kind = SIM_EVENT_OVERFLOW; index = i; }
+        }
+    }
+    if(adc.busy && (adc.done < when)) { when = adc.done; kind = SIM_EVENT_ADC; }
+    if(spi.busy && (spi.done < when)) { when = spi.done; kind = SIM_EVENT_SPI; }
+
+    if(kind == SIM_EVENT_NONE) {
+        if(sim_now < end) { sim_now = end; }
+        return 0;
+    }
+    if(when > sim_now) { sim_now = when; }
+    sim_service();
+
+    switch(kind)
+    {
+    case SIM_EVENT_COMPARE:
+        timer = &timers[index];
+        timer->target[channel] += 0x10000; // Again after a wrap unless the CCR moves
+        if(channel == 0) {
+            if(timer->vector0 != NULL) { dispatch(timer->vector0); }
+        } else if(timer->vector1 != NULL) {
+            *timer->iv = channel * 2;
+            dispatch(timer->vector1);
+        }
+        break;
+    case SIM_EVENT_OVERFLOW:
+        timer = &timers[index];
+        timer->overflows_served++;
+        if(timer->overflows_served >= timer->overflows_flagged) { *timer->ctl &= ~TBIFG; }
+        if(timer->vector1 != NULL) {
+            *timer->iv = TBIV_14;
+            dispatch(timer->vector1);
+        }
+        break;
+    case SIM_EVENT_ADC:
+        adc_complete();
+        break;
+    case SIM_EVENT_SPI:
+        spi_complete();
+        break;
+    }
+    run_tasks();
+    return 1;
+}
+
+
+// Run for the given simulated time.
+void sim_run(double seconds)
+{
+    double end = sim_now + seconds;
+
+    run_tasks();
+    while(step_event(end)) {}
+}
+
+
+// Run until done() returns nonzero, checked after every event, or the timeout
+// passes. Returns 1 if done() was met.
+uint8_t sim_run_until(uint8_t (*done)(void), double timeout)
+{
+    double end = sim_now + timeout;
+
+    run_tasks();
+    while(!done())
+    {
+        if(!step_event(end)) { return 0; }
+    }
+    return 1;
+}
+
+
+// Set up the simulator and the power on register state. Firmware globals are
+// only initialized once per process, so a process simulates one power cycle.
+void sim_reset(const sim_options_t *options)
+{
+    static volatile uint16_t *const ccr[SIM_TIMERS][SIM_CHANNELS] = {
+        { &TB0CCR0, &TB0CCR1, &TB0CCR2 }, { &TB1CCR0, &TB1CCR1, &TB1CCR2 },
+        { &TB2CCR0, &TB2CCR1, &TB2CCR2 },
+        { &TB3CCR0, &TB3CCR1, &TB3CCR2, &TB3CCR3, &TB3CCR4, &TB3CCR5, &TB3CCR6 } };
+    static volatile uint16_t *const cctl[SIM_TIMERS][SIM_CHANNELS] = {
+        { &TB0CCTL0, &TB0CCTL1, &TB0CCTL2 }, { &TB1CCTL0, &TB1CCTL1, &TB1CCTL2 },
+        { &TB2CCTL0, &TB2CCTL1, &TB2CCTL2 },
+        { &TB3CCTL0, &TB3CCTL1, &TB3CCTL2, &TB3CCTL3, &TB3CCTL4, &TB3CCTL5, &TB3CCTL6 } };
+    static volatile uint16_t *const ctl[SIM_TIMERS] = { &TB0CTL, &TB1CTL, &TB2CTL, &TB3CTL };
+    static volatile uint16_t *const ex0[SIM_TIMERS] = { &TB0EX0, &TB1EX0, &TB2EX0, &TB3EX0 };
+    static volatile uint16_t *const iv[SIM_TIMERS] = { &TB0IV, &TB1IV, &TB2IV, &TB3IV };
+    static void (*const vector0[SIM_TIMERS])(void) = { NULL, Timer1_B0, NULL, NULL };
+    static void (*const vector1[SIM_TIMERS])(void) = { Timer0_B1, NULL, Timer2_B1, Timer3_B1 };
+    uint8_t i;
+
+    if(options != NULL) { sim_options = *options; }
+    rng_state = sim_options.seed ? sim_options.seed : 1;
+    sim_now = 0.0;
+    memset(timers, 0, sizeof(timers));
+    for(i = 0; i < SIM_TIMERS; i++)
+    {
+        memcpy(timers[i].ccr, ccr[i], sizeof(timers[i].ccr));
+        memcpy(timers[i].cctl, cctl[i], sizeof(timers[i].cctl));
+        timers[i].ctl = ctl[i];
+        timers[i].ex0 = ex0[i];
+        timers[i].iv = iv[i];
+        timers[i].vector0 = vector0[i];
+        timers[i].vector1 = vector1[i];
+    }
+    memset(&adc, 0, sizeof(adc));
+    memset(sim_adc_conversions, 0, sizeof(sim_adc_conversions));
+    memset(&spi, 0, sizeof(spi));
+
+    // Buttons are pulled up, the internal reference is taken as settled
+    P2IN = P3IN = P4IN = 0xFF;
+    PMMCTL2 = REFGENRDY;
+    UCB1IFG = UCTXIFG;
+    sim_hw.wiper = 0x80;
+}
+
+
+// Initialize the firmware as main() does after clock_configure(), whose FLL waits
+// have nothing to wait for here, and enable interrupts.
+void sim_power_up(void)
+{
+    WDTCTL = WDTPW | WDTHOLD;
+    initialize_task_manager();
+    init_gpio();
+    initialize_relay();
+    initialize_freq_counter();
+    initialize_spi();
+    initialize_stepper_control();
+    ui_init();
+    initialize_adc();
+    P1DIR |= BIT0;
+    P1OUT |= BIT0;
+    PM5CTL0 &= ~LOCKLPM5;
+    __bis_SR_register(GIE);
+    sim_service();
+}
+
+
+// Key the carrier at the given frequency and forward power.
+void sim_key(double freq_hz, double power_w)
+{
+    sim_service();
+    sim_carrier.freq_hz = freq_hz;
+    sim_carrier.power_w = power_w;
+    sim_carrier.keyed = 1;
+    timer_rebase(1);
+}
+
+
+// Remove the carrier.
+void sim_unkey(void)
+{
+    sim_service();
+    sim_carrier.keyed = 0;
+    timer_rebase(1);
+}
+
+
+// Connect a load to the tuner output.
+void sim_set_load(const sim_load_t *load)
+{
+    sim_load = load;
+    load_z_freq = -1.0;
+}
+
+
+// Press the tune button, as its port interrupt sees it.
+void sim_press_tune(void)
+{
+    if(!(P2IE & BIT5)) { return; } // Still debouncing
+    P2IV = P2IV_12;
+    dispatch(Port_2);
+}
+
+
+// Place the motors, before power up or while they are stopped.
+void sim_set_positions(double cap_position, double ind_position)
+{
+    sim_hw.cap_position = cap_position;
+    sim_hw.ind_position = ind_position;
+}
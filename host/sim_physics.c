@@ -0,0 +1,276 @@
+/*
+ * File: sim_physics.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: RF models for the host simulator: the antenna or load, the L-network
+ *              set by the motors and relays, and the SWR bridge with its detectors.
+ *
+ *              The network is a series roller inductor and a shunt capacitor bank
+ *              (varicap plus binary relays) switched to either side of it by P3.4.
+ *              Component values follow the pot mapping the firmware assumes in
+ *              network_to_positions(), so a correct solution in pot counts is a
+ *              correct solution here. The inductor has a finite Q.
+ *
+ *              The bridge sits at the tuner input, with the known 25 ohm resistor in
+ *              series after it when P3.6 is set. Forward power is held constant, as
+ *              a transmitter with ALC would, so FWD follows the power and REF is FWD
+ *              scaled by the reflection magnitude. The detectors are taken as linear.
+ *
+ *              Antennas are a center fed dipole from the induced EMF method, with the
+ *              input referred through the current distribution, and a vertical over
+ *              ground as half of the dipole of twice its height plus a loss term.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+
+
+// Function Prototypes
+static double si(double x);
+static double ci(double x);
+static double complex dipole_impedance(double length, double radius, double freq_hz);
+
+
+#define EULER_GAMMA                 0.5772156649015329
+#define ETA0                        376.730313668
+#define SPEED_OF_LIGHT              299792458.0
+#define INTEGRAL_STEPS              4000 // Simpson intervals for Si and Ci
+#define SIN_SQUARED_MIN             0.01 // Limits the input resistance near full wave
+
+
+// Sine integral, by Simpson's rule.
+static double si(double x)
+{
+    double h = x / INTEGRAL_STEPS, sum = 0.0, t;
+    int i;
+
+    if(x == 0.0) { return 0.0; }
+    for(i = 0; i <= INTEGRAL_STEPS; i++)
+    {
+        t = i * h;
+        double f = (t == 0.0) ? 1.0 : sin(t) / t;
+        sum += f * ((i == 0 || i == INTEGRAL_STEPS) ? 1.0 : ((i & 1) ? 4.0 : 2.0));
+    }
+    return sum * h / 3.0;
+}
+
+
+// Cosine integral, as gamma + ln(x) + the integral of (cos(t) - 1) / t.
+static double ci(double x)
+{
+    double h = x / INTEGRAL_STEPS, sum = 0.0, t;
+    int i;
+
+    for(i = 0; i <= INTEGRAL_STEPS; i++)
+    {
+        t = i * h;
+        double f = (t == 0.0) ? 0.0 : (cos(t) - 1.0) / t;
+        sum += f * ((i == 0 || i == INTEGRAL_STEPS) ? 1.0 : ((i & 1) ? 4.0 : 2.0));
+    }
+    return EULER_GAMMA + log(x) + sum * h / 3.0;
+}
+
+
+// Input impedance of a center fed dipole, from the radiation impedance referred
+// to the current maximum and divided by sin^2(kl / 2) to refer it to the feed.
+static double complex dipole_impedance(double length, double radius, double freq_hz)
+{
+    double k = 2.0 * M_PI * freq_hz / SPEED_OF_LIGHT;
+    double kl = k * length, r, x, s2;
+
+    r = (ETA0 / (2.0 * M_PI)) * (EULER_GAMMA + log(kl) - ci(kl)
+        + 0.5 * sin(kl) * (si(2.0 * kl) - 2.0 * si(kl))
+        + 0.5 * cos(kl) * (EULER_GAMMA + log(kl / 2.0) + ci(2.0 * kl) - 2.0 * ci(kl)));
+    x = (ETA0 / (4.0 * M_PI)) * (2.0 * si(kl) + cos(kl) * (2.0 * si(kl) - si(2.0 * kl))
+        - sin(kl) * (2.0 * ci(kl) - ci(2.0 * kl) - ci(2.0 * k * radius * radius / length)));
+    s2 = sin(kl / 2.0) * sin(kl / 2.0);
+    if(s2 < SIN_SQUARED_MIN) { s2 = SIN_SQUARED_MIN; }
+    return (r + I * x) / s2;
+}
+
+
+// Impedance of a load at the given frequency.
+double complex sim_load_impedance(const sim_load_t *load, double freq_hz)
+{
+    uint16_t i;
+    double t;
+
+    switch(load->model)
+    {
+    case SIM_LOAD_DIPOLE:
+        return dipole_impedance(load->length, load->radius, freq_hz) + load->loss;
+
+    case SIM_LOAD_MONOPOLE:
+        return dipole_impedance(2.0 * load->length, load->radius, freq_hz) / 2.0 + load->loss;
+
+    case SIM_LOAD_TABLE:
+        // Linear between the measured points, held beyond the ends
+        if(freq_hz <= load->table_hz[0]) { return load->table_z[0]; }
+        for(i = 1; i < load->table_points; i++)
+        {
+            if(freq_hz <= load->table_hz[i])
+            {
+                t = (freq_hz - load->table_hz[i - 1]) / (load->table_hz[i] - load->table_hz[i - 1]);
+                return load->table_z[i - 1] + t * (load->table_z[i] - load->table_z[i - 1]);
+            }
+        }
+        return load->table_z[load->table_points - 1];
+
+    default:
+        return load->r + I * load->x;
+    }
+}
+
+
+// Capacitance of the shunt bank, relays plus varicap.
+double sim_capacitance_pf(const sim_hw_t *hw)
+{
+    double position = hw->cap_position;
+
+    if(position < 0.0) { position = 0.0; }
+    return hw->relays * SIM_RELAY_PF + position * SIM_CAP_PF_PER_COUNT;
+}
+
+
+// Inductance of the roller inductor.
+double sim_inductance_uh(const sim_hw_t *hw)
+{
+    double position = hw->ind_position;
+
+    if(position < 0.0) { position = 0.0; }
+    return position * SIM_IND_UH_PER_COUNT;
+}
+
+
+// Impedance seen at the tuner input looking into the network and load.
+double complex sim_network_impedance(double freq_hz, double complex z_load, const sim_hw_t *hw)
+{
+    double w = 2.0 * M_PI * freq_hz;
+    double xl = w * sim_inductance_uh(hw) * 1e-6;
+    double complex z_series = xl / SIM_INDUCTOR_Q + I * xl;
+    double complex y_shunt = I * w * sim_capacitance_pf(hw) * 1e-12;
+    double complex z;
+
+    if(hw->cap_input_side)
+    {
+        z = z_load + z_series;
+        z = z / (1.0 + z * y_shunt);
+    } else {
+        z = z_load / (1.0 + z_load * y_shunt);
+        z = z + z_series;
+    }
+    return z;
+}
+
+
+// Reflection magnitude of an impedance against a real reference.
+double sim_reflection(double complex z, double z0)
+{
+    return cabs((z - z0) / (z + z0));
+}
+
+
+// VSWR of a reflection magnitude.
+double sim_vswr(double gamma)
+{
+    if(gamma >= 1.0) { return SIM_VSWR_OPEN; }
+    gamma = (1.0 + gamma) / (1.0 - gamma);
+    return (gamma > SIM_VSWR_OPEN) ? SIM_VSWR_OPEN : gamma;
+}
+
+
+// Detector voltages at the bridge for the current network, known impedance included.
+void sim_detectors(double freq_hz, double power_w, double complex z_load, const sim_hw_t *hw,
+                   double *fwd_volts, double *ref_volts)
+{
+    double complex z = sim_network_impedance(freq_hz, z_load, hw);
+
+    if(hw->known_in) { z += SIM_KNOWN_OHMS; }
+    *fwd_volts = SIM_DETECTOR_V_PER_SQRT_W * sqrt(power_w);
+    *ref_volts = *fwd_volts * sim_reflection(z, SIM_Z0);
+}
+
+
+// VSWR the transmitter sees through the network, known impedance switched out.
+double sim_matched_vswr(double freq_hz, double complex z_load, const sim_hw_t *hw)
+{
+    return sim_vswr(sim_reflection(sim_network_impedance(freq_hz, z_load, hw), SIM_Z0));
+}
+
+
+// Read a load corpus. Each line holds a name, the carrier frequency in MHz and a
+// model with its parameters:
+//     fixed <R ohms> <X ohms>
+//     dipole <length m> <wire radius m> [loss ohms]
+//     monopole <height m> <wire radius m> [ground loss ohms]
+//     s1p <Touchstone file, relative to the corpus>
+// Blank lines and lines starting with # are skipped. Returns the number of loads
+// read, or -1 if the file cannot be opened or a line is malformed.
+int sim_load_corpus(const char *path, sim_load_t *loads, double *freq_hz, int max_loads)
+{
+    char line[256], model[16], name[SIM_LOAD_NAME_LEN], table[512];
+    const char *directory_end = strrchr(path, '/');
+    double mhz, a, b, c;
+    int directory = directory_end ? (int)(directory_end - path + 1) : 0;
+    int count = 0, fields, line_number = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL) { return -1; }
+    while(fgets(line, sizeof(line), file) && (count < max_loads))
+    {
+        line_number++;
+        if((line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line))) { continue; }
+        c = 0.0;
+        fields = sscanf(line, "%31s %lf %15s %lf %lf %lf", loads[count].name, &mhz, model, &a, &b, &c);
+        if((fields == 3) && (strcmp(model, "s1p") == 0))
+        {
+            // Measured load, named by the corpus rather than the file
+            strcpy(name, loads[count].name);
+            snprintf(table, sizeof(table), "%.*s", directory, path);
+            if((sscanf(line, "%*s %*s %*s %255s", table + strlen(table)) != 1) ||
+               (sim_load_touchstone(table, &loads[count]) < 0))
+            {
+                fprintf(stderr, "%s:%d: cannot read %s\n", path, line_number, table);
+                fclose(file);
+                return -1;
+            }
+            strcpy(loads[count].name, name);
+            freq_hz[count++] = mhz * 1e6;
+            continue;
+        }
+        if(fields < 5)
+        {
+            fprintf(stderr, "%s:%d: expected name, MHz, model and parameters\n", path, line_number);
+            fclose(file);
+            return -1;
+        }
+        freq_hz[count] = mhz * 1e6;
+        if(strcmp(model, "fixed") == 0) {
+            loads[count].model = SIM_LOAD_FIXED;
+            loads[count].r = a;
+            loads[count].x = b;
+        } else if(strcmp(model, "dipole") == 0) {
+            loads[count].model = SIM_LOAD_DIPOLE;
+            loads[count].length = a;
+            loads[count].radius = b;
+            loads[count].loss = c;
+        } else if(strcmp(model, "monopole") == 0) {
+            loads[count].model = SIM_LOAD_MONOPOLE;
+            loads[count].length = a;
+            loads[count].radius = b;
+            loads[count].loss = c;
+        } else {
+            fprintf(stderr, "%s:%d: unknown model %s\n", path, line_number, model);
+            fclose(file);
+            return -1;
+        }
+        count++;
+    }
+    fclose(file);
+    return count;
+}
@@ -0,0 +1,144 @@
+/*
+ * File: swrbench.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Microbenchmark of one SWR probe's arithmetic: the reflection
+ *              coefficient from a linearized REF/FWD pair and the VSWR from it.
+ *              The division free reflection_ratio() and vswr_from_gamma() are timed
+ *              against the IQmath path they replaced, _IQ19div and _IQ16div, over
+ *              the same pseudo random pairs.
+ *
+ *              The figures are host nanoseconds. The host divides in hardware and
+ *              iqmath_host.c stands in for the TI library, which favours IQmath here.
+ *              The MSP430 has no divider, so the IQmath path is also timed with a
+ *              bit serial divide in the place of the host's. That is closer to the
+ *              target, but cycle counts on the MSP430 must still be read there.
+ *
+ *              Usage: swrbench [-n calls]
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "intellitune.h"
+
+
+#define PAIRS                       4096 // Power of two
+#define DEFAULT_CALLS               20000000L
+
+
+static uint32_t fwd_values[PAIRS], ref_values[PAIRS];
+static volatile _iq16 sink;
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+// Unsigned restoring divide, one quotient bit per step as software does it
+// without a divider.
+static uint32_t serial_divide(uint64_t dividend, uint32_t divisor)
+{
+    uint64_t remainder = 0;
+    uint32_t quotient = 0;
+    int8_t bit;
+
+    if(divisor == 0) { return 0xFFFFFFFF; }
+    for(bit = 63; bit >= 0; bit--)
+    {
+        remainder = (remainder << 1) | ((dividend >> bit) & 1);
+        quotient <<= 1;
+        if(remainder >= divisor) { remainder -= divisor; quotient |= 1; }
+    }
+    return quotient;
+}
+
+
+// Reflection coefficient and VSWR without division, as the firmware computes them.
+static double time_table(long calls)
+{
+    double start = now_ns();
+    long i;
+
+    for(i = 0; i < calls; i++)
+    {
+        sink = vswr_from_gamma(reflection_ratio(ref_values[i & (PAIRS - 1)], fwd_values[i & (PAIRS - 1)]));
+    }
+    return (now_ns() - start) / calls;
+}
+
+
+// The same with the IQmath divides calculate_ref_coeff() and update_swr() used.
+static double time_iqmath(long calls)
+{
+    double start = now_ns();
+    _iq16 gamma;
+    long i;
+
+    for(i = 0; i < calls; i++)
+    {
+        gamma = _IQ19toIQ(_IQ19div((_iq19)ref_values[i & (PAIRS - 1)], (_iq19)fwd_values[i & (PAIRS - 1)]));
+        sink = _IQ16div(_IQ16(1.0) + gamma, _IQ16(1.0) - gamma);
+    }
+    return (now_ns() - start) / calls;
+}
+
+
+// The IQmath path with bit serial divides.
+static double time_serial(long calls)
+{
+    double start = now_ns();
+    _iq16 gamma;
+    long i;
+
+    for(i = 0; i < calls; i++)
+    {
+        gamma = (_iq16)(serial_divide((uint64_t)ref_values[i & (PAIRS - 1)] << 19, fwd_values[i & (PAIRS - 1)]) >> 3);
+        sink = (_iq16)serial_divide((uint64_t)(_IQ16(1.0) + gamma) << 16, _IQ16(1.0) - gamma);
+    }
+    return (now_ns() - start) / calls;
+}
+
+
+int main(int argc, char **argv)
+{
+    long calls = DEFAULT_CALLS;
+    double table_ns, iqmath_ns, serial_ns;
+    uint32_t seed = 1;
+    int i;
+
+    if((argc == 3) && (strcmp(argv[1], "-n") == 0)) { calls = atol(argv[2]); }
+    else if(argc != 1)
+    {
+        fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+        return 2;
+    }
+    if(calls <= 0) { calls = DEFAULT_CALLS; }
+
+    // FWD across the linearized range, REF below it
+    for(i = 0; i < PAIRS; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        fwd_values[i] = (seed >> 8) | (1UL << DET_TABLE_BASE_SHIFT);
+        seed = seed * 1664525 + 1013904223;
+        ref_values[i] = (uint32_t)(((uint64_t)fwd_values[i] * (seed >> 16)) >> 16);
+    }
+
+    time_table(calls / 10); // Warm up
+    table_ns = time_table(calls);
+    iqmath_ns = time_iqmath(calls);
+    serial_ns = time_serial(calls);
+    printf("swrbench: %ld probes on this host\n", calls);
+    printf("  without division       %7.2f ns\n", table_ns);
+    printf("  IQmath, host divider   %7.2f ns  %.2fx\n", iqmath_ns, iqmath_ns / table_ns);
+    printf("  IQmath, serial divide  %7.2f ns  %.2fx\n", serial_ns, serial_ns / table_ns);
+    return 0;
+}
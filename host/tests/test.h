@@ -0,0 +1,38 @@
+/*
+ * File: test.h
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Checks for the host tests. Each test is a program built against the
+ *              firmware and simulator, which prints every failed check and returns
+ *              nonzero if there was one. "make test" runs them all.
+ *
+ ******************************************************************************/
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+
+static int test_checks = 0, test_failures = 0;
+
+
+// Count a check and print the formatted message if it fails.
+#define CHECK(condition, ...)                                                   \
+    do {                                                                        \
+        test_checks++;                                                          \
+        if(!(condition)) {                                                      \
+            test_failures++;                                                    \
+            printf("%s:%d: %s: ", __FILE__, __LINE__, #condition);              \
+            printf(__VA_ARGS__);                                                \
+            printf("\n");                                                       \
+        }                                                                       \
+    } while(0)
+
+// Print the totals and give main()'s return value.
+#define TEST_RESULT(name)                                                       \
+    (printf("%-24s %4d checks, %d failed\n", (name), test_checks, test_failures), \
+     (test_failures != 0))
+
+#endif
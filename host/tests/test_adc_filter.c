@@ -0,0 +1,142 @@
+/*
+ * File: test_adc_filter.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the ADC oversampling filters with synthetic noisy
+ *              input. For every response and oversampling ratio, a level between
+ *              two ADC codes is fed with gaussian noise through update_adc_filter().
+ *              The output rate, the mean at ADC_HIRES scale and the reduction of the
+ *              noise must follow the ratio. The simulated pots are then read with
+ *              noise while the firmware runs, and the filtered cap_sample must be
+ *              quieter than raw conversions.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define INPUTS                      16384
+#define LEVEL                       1000.37 // ADC counts, between two codes
+#define NOISE_RMS                   3.0     // ADC counts
+#define MEAN_TOLERANCE              0.1     // ADC counts
+#define NOISE_SLACK                 1.25    // Measured rms over NOISE_RMS / sqrt(ratio)
+#define POT_NOISE_RMS               4.0
+#define POT_SAMPLES                 500
+#define POT_NOISE_GAIN_MIN          2.5     // Raw over CIC 16 rms of cap_sample
+
+
+extern uint8_t update_adc_filter(adc_filter_t *filter, uint16_t adc_reading, uint16_t *output);
+
+
+static uint16_t noisy_reading(void)
+{
+    return (uint16_t)lround(LEVEL + NOISE_RMS * sim_gauss());
+}
+
+
+// Feed INPUTS readings through one filter and check its outputs.
+static void check_filter(uint8_t type, uint8_t shift, const char *name)
+{
+    adc_filter_t filter;
+    uint16_t output;
+    uint32_t i, outputs = 0, expected;
+    double sum = 0.0, sum_sq = 0.0, counts, mean, rms, limit;
+
+    set_adc_filter(type, shift);
+    memset(&filter, 0, sizeof(filter));
+    for(i = 0; i < INPUTS; i++)
+    {
+        if(!update_adc_filter(&filter, noisy_reading(), &output)) { continue; }
+        counts = (double)output / ADC_HIRES(1); // Back to ADC counts, keeping the extra bits
+        sum += counts;
+        sum_sq += counts * counts;
+        outputs++;
+    }
+    expected = (type == ADC_FILTER_CIC) ? (INPUTS >> shift) : (INPUTS - (1 << shift) + 1);
+    if(type == ADC_FILTER_NONE) { expected = INPUTS; }
+    CHECK(outputs == expected, "%s: %u outputs from %u inputs, expected %u", name, outputs, INPUTS, expected);
+    if(outputs < 2) { return; }
+
+    mean = sum / outputs;
+    rms = sqrt(sum_sq / outputs - mean * mean);
+    limit = NOISE_SLACK * NOISE_RMS / sqrt((type == ADC_FILTER_NONE) ? 1.0 : (double)(1 << shift));
+    CHECK(fabs(mean - LEVEL) < MEAN_TOLERANCE, "%s: mean %.3f counts, level %.3f", name, mean, LEVEL);
+    CHECK(rms < limit, "%s: noise %.3f counts rms, limit %.3f", name, rms, limit);
+}
+
+
+// Full scale conversions must not overflow the 16-bit output.
+static void check_full_scale(uint8_t type)
+{
+    adc_filter_t filter;
+    uint16_t output = 0, i;
+
+    set_adc_filter(type, ADC_FILTER_MAX_SHIFT);
+    memset(&filter, 0, sizeof(filter));
+    for(i = 0; i < ADC_FILTER_LEN; i++) { update_adc_filter(&filter, 4095, &output); }
+    CHECK(output == ADC_HIRES(4095), "filter %u: full scale reads %u, expected %u", type, output,
+          ADC_HIRES(4095));
+}
+
+
+// Spread of cap_sample read every millisecond while the firmware runs.
+static double cap_sample_rms(void)
+{
+    double sum = 0.0, sum_sq = 0.0, mean;
+    uint16_t i;
+
+    for(i = 0; i < POT_SAMPLES; i++)
+    {
+        sim_run(0.001);
+        sum += cap_sample;
+        sum_sq += (double)cap_sample * cap_sample;
+    }
+    mean = sum / POT_SAMPLES;
+    return sqrt(sum_sq / POT_SAMPLES - mean * mean);
+}
+
+
+int main(void)
+{
+    sim_options_t options = {0};
+    double raw_rms, filtered_rms;
+    char name[16];
+    uint8_t shift;
+
+    options.seed = 1;
+    options.noise_pot = POT_NOISE_RMS;
+    sim_reset(&options);
+
+    check_filter(ADC_FILTER_NONE, 0, "none");
+    for(shift = 1; shift <= ADC_FILTER_MAX_SHIFT; shift++)
+    {
+        snprintf(name, sizeof(name), "cic_%u", 1 << shift);
+        check_filter(ADC_FILTER_CIC, shift, name);
+        snprintf(name, sizeof(name), "ma_%u", 1 << shift);
+        check_filter(ADC_FILTER_MA, shift, name);
+    }
+
+    check_full_scale(ADC_FILTER_CIC);
+    check_full_scale(ADC_FILTER_MA);
+
+    // The pots while the firmware runs, raw against the widest CIC
+    sim_set_positions(2000.0, 2000.0);
+    sim_power_up();
+    set_adc_filter(ADC_FILTER_NONE, 0);
+    sim_run(0.1);
+    raw_rms = cap_sample_rms();
+    set_adc_filter(ADC_FILTER_CIC, ADC_FILTER_MAX_SHIFT);
+    sim_run(0.1);
+    filtered_rms = cap_sample_rms();
+    CHECK(filtered_rms * POT_NOISE_GAIN_MIN < raw_rms, "cap_sample noise %.2f counts filtered, %.2f raw",
+          filtered_rms, raw_rms);
+    printf("adc_filter: cap_sample noise %.2f counts rms raw, %.2f with CIC %u\n", raw_rms, filtered_rms,
+           ADC_FILTER_LEN);
+
+    return TEST_RESULT("test_adc_filter");
+}
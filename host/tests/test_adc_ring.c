@@ -0,0 +1,311 @@
+/*
+ * File: test_adc_ring.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host stress test of the ADC pair ring under interrupt preemption.
+ *              The simulator never lets an interrupt preempt a task, so here the
+ *              consumer calls are single stepped with the x86 trap flag and the
+ *              producer, push_adc_record() as the ADC interrupt calls it, runs from
+ *              the trap handler before each instruction in turn. Every call of
+ *              adc_ring_count(), adc_ring_peek(), adc_ring_read() and
+ *              adc_ring_discard() is preempted at every point, from ring states
+ *              that are empty, part full, full and wrapped past the end. Each
+ *              preemption pushes one record, two, or a whole ring's worth as a
+ *              consumer held off for long would see.
+ *
+ *              Each record carries its sequence number in every field, so a torn
+ *              copy shows. Afterwards the ring is drained, and every record must
+ *              arrive exactly once and in order, apart from those released by a
+ *              discard. A push onto a full ring must be dropped and counted, and
+ *              only then. Hosts without the trap flag preempt each call before it
+ *              starts instead.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <string.h>
+#include <ucontext.h>
+#include "intellitune.h"
+#include "tests/test.h"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RING_STEPPING               1
+#define TRAP_FLAG                   0x100
+#endif
+
+#define OP_COUNT                    0
+#define OP_PEEK_FIRST               1
+#define OP_PEEK_LAST                2
+#define OP_PEEK_PAST                3   // One past the last unread record
+#define OP_READ                     4
+#define OP_DISCARD                  5
+#define NUM_OPS                     6
+
+
+extern volatile adc_record_t adc_ring[ADC_RING_SIZE];
+extern volatile uint8_t adc_ring_head, adc_ring_tail;
+extern uint8_t seq_known_switched;
+extern void push_adc_record(uint16_t timestamp, uint16_t fwd, uint16_t ref);
+
+
+static const char *const op_names[NUM_OPS] = { "count", "peek first", "peek last", "peek past", "read",
+                                               "discard" };
+static const uint8_t tails[] = { 0, 1, ADC_RING_SIZE / 2, ADC_RING_SIZE - 2, ADC_RING_SIZE - 1 };
+static const uint8_t counts[] = { 0, 1, 2, ADC_RING_SIZE / 2, ADC_RING_SIZE - 2, ADC_RING_SIZE - 1 };
+static const uint8_t bursts[] = { 1, 2, ADC_RING_SIZE }; // Records pushed by one preemption
+
+static uint16_t next_seq = 0; // Sequence number of the next record pushed
+static uint32_t pushes = 0;
+static volatile uint32_t traps, preempt_at;
+static volatile uint8_t preempted, dropped, burst, kept;
+static adc_record_t op_record;
+
+
+// Push the next record as the ADC interrupt does. A push is dropped only when
+// the ring is full.
+static void producer(void)
+{
+    uint8_t full = (adc_ring_count() == ADC_RING_SIZE - 1);
+    uint16_t overruns = adc_ring_overruns;
+
+    seq_known_switched = next_seq & 1;
+    seq_gain_epoch = (uint8_t)next_seq;
+    wiper_code = (uint8_t)(next_seq >> 8);
+    push_adc_record(next_seq, (uint16_t)(next_seq * 3 + 1), (uint16_t)~next_seq);
+    dropped = (adc_ring_overruns != overruns);
+    CHECK(dropped == full, "record %u %s a %s ring", next_seq, dropped ? "dropped from" : "pushed onto",
+          full ? "full" : "part full");
+    next_seq++;
+    pushes++;
+}
+
+
+// Interrupt the consumer with a burst of records. Once one is dropped the rest
+// are too, so the records kept are the first of the burst.
+static void preempt(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < burst; i++)
+    {
+        producer();
+        kept += !dropped;
+    }
+    preempted = 1;
+}
+
+
+// Check every field of a record against its sequence number.
+static uint8_t intact(const adc_record_t *record, uint16_t seq)
+{
+    return (record->timestamp == seq) && (record->fwd == (uint16_t)(seq * 3 + 1)) &&
+           (record->ref == (uint16_t)~seq) && (record->known_switched == (seq & 1)) &&
+           (record->gain_epoch == (uint8_t)seq) && (record->gain_code == (uint8_t)(seq >> 8));
+}
+
+
+#ifdef RING_STEPPING
+// Count each single stepped instruction and run the producer before the chosen
+// one. Stepping stops once the producer has run.
+static void trap_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+
+    (void)sig;
+    (void)info;
+    if(++traps != preempt_at) { return; }
+    preempt();
+    uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+}
+
+
+static inline void trap_flag_set(void)
+{
+    __asm__ volatile("pushf\n\torl $0x100, (%%"
+#ifdef __x86_64__
+                     "rsp"
+#else
+                     "esp"
+#endif
+                     ")\n\tpopf" ::: "memory", "cc");
+}
+
+
+static inline void trap_flag_clear(void)
+{
+    __asm__ volatile("pushf\n\tandl $0xFFFFFEFF, (%%"
+#ifdef __x86_64__
+                     "rsp"
+#else
+                     "esp"
+#endif
+                     ")\n\tpopf" ::: "memory", "cc");
+}
+#endif
+
+
+// Run one consumer call, preempted before instruction preempt_at if it is not 0.
+// Returns the call's result.
+static __attribute__((noinline)) int run_op(uint8_t op, uint8_t index)
+{
+    int result = 0;
+
+    traps = 0;
+    preempted = 0;
+    kept = 0;
+#ifdef RING_STEPPING
+    trap_flag_set();
+#else
+    if(preempt_at == 1) { preempt(); }
+#endif
+    switch(op)
+    {
+    case OP_COUNT:
+        result = adc_ring_count();
+        break;
+    case OP_PEEK_FIRST:
+    case OP_PEEK_LAST:
+    case OP_PEEK_PAST:
+        result = adc_ring_peek(index, &op_record);
+        break;
+    case OP_READ:
+        result = adc_ring_read(&op_record);
+        break;
+    case OP_DISCARD:
+        adc_ring_discard();
+        break;
+    }
+#ifdef RING_STEPPING
+    trap_flag_clear();
+#else
+    traps = 1;
+#endif
+    return result;
+}
+
+
+// Set the ring to hold count records starting at slot tail. Returns the
+// sequence number of the oldest.
+static uint16_t fill(uint8_t tail, uint8_t count)
+{
+    uint16_t first = next_seq;
+    uint8_t i;
+
+    adc_ring_tail = tail;
+    adc_ring_head = tail;
+    adc_ring_overruns = 0;
+    for(i = 0; i < count; i++) { producer(); }
+    return first;
+}
+
+
+// Read out the ring and check it holds exactly the records from first up to
+// but not including last, in order.
+static void drain(uint16_t first, uint16_t last, const char *what)
+{
+    adc_record_t record;
+    uint16_t seq = first;
+
+    while(adc_ring_read(&record))
+    {
+        CHECK(intact(&record, seq), "%s: record %u read back as %u", what, seq, record.timestamp);
+        seq++;
+    }
+    CHECK(seq == last, "%s: %u records read back, %u expected", what, (uint16_t)(seq - first),
+          (uint16_t)(last - first));
+}
+
+
+// Check one consumer call from one ring state, preempted before its instruction
+// point. The records the producer kept follow on from first + count.
+static void check_op(uint8_t op, uint8_t tail, uint8_t count, uint32_t point)
+{
+    char what[80];
+    uint16_t first = fill(tail, count), last;
+    uint8_t index = (op == OP_PEEK_LAST) ? count - 1 : (op == OP_PEEK_PAST) ? count : 0;
+    uint8_t remaining;
+    int result;
+
+    snprintf(what, sizeof(what), "%s of %u from slot %u, %u pushed at point %lu", op_names[op], count, tail,
+             burst, (unsigned long)point);
+    preempt_at = point;
+    result = run_op(op, index);
+    CHECK((point == 0) || preempted, "%s: producer never ran", what);
+    last = first + count + kept;
+
+    switch(op)
+    {
+    case OP_COUNT:
+        CHECK((result >= count) && (result <= count + kept), "%s: count %d", what, result);
+        drain(first, last, what);
+        break;
+    case OP_PEEK_FIRST:
+    case OP_PEEK_LAST:
+    case OP_PEEK_PAST:
+        if(index < count) {
+            CHECK(result && intact(&op_record, first + index), "%s: peek gave %u", what, op_record.timestamp);
+        } else {
+            CHECK(!result || (kept && intact(&op_record, first + index)), "%s: peek gave %u", what,
+                  op_record.timestamp);
+        }
+        drain(first, last, what);
+        break;
+    case OP_READ:
+        if(result) {
+            CHECK(intact(&op_record, first), "%s: read gave %u", what, op_record.timestamp);
+            drain(first + 1, last, what);
+        } else {
+            CHECK(count == 0, "%s: nothing read", what); // A record pushed after the check waits
+            drain(first, last, what);
+        }
+        break;
+    case OP_DISCARD:
+        // Records pushed part way through may be released with the rest or kept
+        remaining = adc_ring_count();
+        CHECK(remaining <= kept, "%s: %u records left", what, remaining);
+        drain(last - remaining, last, what);
+        break;
+    }
+}
+
+
+int main(void)
+{
+    uint32_t point, points, total = 0;
+    uint8_t op, t, c, b;
+#ifdef RING_STEPPING
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = trap_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGTRAP, &action, NULL);
+#endif
+
+    for(op = 0; op < NUM_OPS; op++)
+    {
+        for(t = 0; t < sizeof(tails); t++)
+        {
+            for(c = 0; c < sizeof(counts); c++)
+            {
+                if((op == OP_PEEK_LAST) && (counts[c] == 0)) { continue; }
+                // Count the points of the call, then preempt it at each in turn
+                check_op(op, tails[t], counts[c], 0);
+                points = traps;
+                for(b = 0; b < sizeof(bursts); b++)
+                {
+                    burst = bursts[b];
+                    for(point = 1; point <= points; point++) { check_op(op, tails[t], counts[c], point); }
+                }
+                total += points * sizeof(bursts);
+            }
+        }
+    }
+
+    printf("adc_ring: %lu preemption points over %u calls from %u ring states, %lu records pushed\n",
+           (unsigned long)total, NUM_OPS, (unsigned)(sizeof(tails) * sizeof(counts)), (unsigned long)pushes);
+    return TEST_RESULT("test_adc_ring");
+}
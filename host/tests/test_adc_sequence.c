@@ -0,0 +1,162 @@
+/*
+ * File: test_adc_sequence.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the ADC channel schedule. The segments
+ *              next_adc_segment() picks are checked over one schedule cycle in each
+ *              system state, then the simulated ADC counts the conversions on each
+ *              channel while the firmware runs. Sequence mode must convert every
+ *              channel in every cycle, favour what the state depends on, and convert
+ *              a full round several times as often as the single conversion mode.
+ *              A moving motor's pot must be converted at least twice as often as in
+ *              full rounds.
+ *
+ ******************************************************************************/
+
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define SETTLE_S                    0.3
+#define MEASURE_S                   0.5
+#define FAVOURED_RATIO              (ADC_SCHED_SLOTS - 1) // Favoured channels per cycle, at least
+#define SEQUENCE_GAIN_MIN           4.0 // Full round rate of sequence mode over single mode
+#define MOVING_GAIN_MIN             2.0 // Moving pot rate over the full round rate
+
+
+typedef struct
+{
+    const char *name;
+    uint8_t task_flag, button_press;
+    uint8_t favoured[4];        // Channels converted in every slot, 0 terminated
+} state_t;
+
+
+extern uint8_t adc_sched_slot;
+extern uint8_t seq_last_channel;
+extern uint8_t next_adc_segment(void);
+extern void set_adc_mode(uint8_t mode);
+
+
+static const uint8_t channels[4] = { REF_PIN, FWD_PIN, IND_PIN, CAP_PIN };
+static const char *const channel_names[4] = { "REF", "FWD", "IND", "CAP" };
+
+
+static uint8_t favoured(const state_t *state, uint8_t channel)
+{
+    uint8_t i;
+
+    for(i = 0; state->favoured[i] != 0; i++) { if(state->favoured[i] == channel) { return 1; } }
+    return 0;
+}
+
+
+// Run one schedule cycle in a state and count the slots that convert each channel.
+static void check_schedule(const state_t *state)
+{
+    uint8_t saved_flag = task_flag, saved_press = button_press, saved_slot = adc_sched_slot;
+    uint8_t slot, first, channel, i, count[4] = {0};
+
+    task_flag = state->task_flag;
+    button_press = state->button_press;
+    adc_sched_slot = 0;
+    for(slot = 0; slot < ADC_SCHED_SLOTS; slot++)
+    {
+        first = next_adc_segment();
+        CHECK((first <= REF_PIN) && (seq_last_channel >= CAP_PIN) && (seq_last_channel <= first),
+              "%s slot %u: segment A%u to A%u", state->name, slot, first, seq_last_channel);
+        if(slot == 0) {
+            CHECK((first == REF_PIN) && (seq_last_channel == CAP_PIN), "%s: slot 0 is not a full sequence",
+                  state->name);
+        }
+        for(channel = first; channel >= seq_last_channel; channel--) { count[REF_PIN - channel]++; }
+    }
+    for(i = 0; i < 4; i++)
+    {
+        if(favoured(state, channels[i])) {
+            CHECK(count[i] == ADC_SCHED_SLOTS, "%s: %s in %u of %u slots", state->name, channel_names[i],
+                  count[i], ADC_SCHED_SLOTS);
+        } else {
+            CHECK(count[i] >= 1, "%s: %s never converted", state->name, channel_names[i]);
+        }
+    }
+    task_flag = saved_flag;
+    button_press = saved_press;
+    adc_sched_slot = saved_slot;
+}
+
+
+// Conversions per second on each channel while the firmware runs.
+static void measure_rates(double rates[4])
+{
+    uint32_t start[4];
+    uint8_t i;
+
+    for(i = 0; i < 4; i++) { start[i] = sim_adc_conversions[channels[i]]; }
+    sim_run(MEASURE_S);
+    for(i = 0; i < 4; i++) { rates[i] = (sim_adc_conversions[channels[i]] - start[i]) / MEASURE_S; }
+}
+
+
+int main(void)
+{
+    static const state_t states[] = {
+        { "idle", 0, 0, { IND_PIN, CAP_PIN, 0 } },
+        { "carrier", RF_PRESENT, 0, { REF_PIN, FWD_PIN, IND_PIN, CAP_PIN } },
+        { "tuning", RF_PRESENT, TUNE, { REF_PIN, FWD_PIN, 0 } },
+        { "cap_moving", MOTOR_ACTIVE | CAP_MOTOR_ACTIVE | RF_PRESENT, TUNE, { CAP_PIN, 0 } },
+        { "ind_moving", MOTOR_ACTIVE | IND_MOTOR_ACTIVE, 0, { IND_PIN, 0 } },
+        { "both_moving", MOTOR_ACTIVE | CAP_MOTOR_ACTIVE | IND_MOTOR_ACTIVE, TUNE, { IND_PIN, CAP_PIN, 0 } },
+    };
+    static const sim_load_t matched = { .model = SIM_LOAD_FIXED, .r = 50.0, .x = 0.0 };
+    sim_options_t options = {0};
+    double idle[4], moving[4], carrier[4], single[4];
+    uint8_t i;
+
+    for(i = 0; i < sizeof(states) / sizeof(states[0]); i++) { check_schedule(&states[i]); }
+
+    options.seed = 1;
+    sim_reset(&options);
+    sim_set_positions(2000.0, 2000.0);
+    sim_power_up();
+    sim_run(SETTLE_S);
+
+    // No carrier, the pots take three of four sequences
+    measure_rates(idle);
+    CHECK(idle[2] >= FAVOURED_RATIO * idle[1], "idle: IND %.0f/s, FWD %.0f/s", idle[2], idle[1]);
+    CHECK(idle[1] > 0.0, "idle: FWD never converted");
+
+    // A motor flagged as moving takes three of four sequences for its pot
+    task_flag |= CAP_MOTOR_ACTIVE;
+    measure_rates(moving);
+    task_flag &= ~CAP_MOTOR_ACTIVE;
+    CHECK(moving[3] >= FAVOURED_RATIO * moving[2], "cap moving: CAP %.0f/s, IND %.0f/s", moving[3], moving[2]);
+
+    // Carrier without a tune converts every channel in every sequence
+    sim_set_load(&matched);
+    sim_key(14.2e6, 10.0);
+    sim_run(SETTLE_S);
+    CHECK(task_flag & RF_PRESENT, "carrier not detected");
+    measure_rates(carrier);
+    for(i = 1; i < 4; i++) {
+        CHECK(carrier[i] >= 0.95 * carrier[0], "carrier: %s %.0f/s, REF %.0f/s", channel_names[i], carrier[i],
+              carrier[0]);
+    }
+
+    // The same rounds converted one channel at a time
+    set_adc_mode(ADC_MODE_SINGLE);
+    sim_run(SETTLE_S);
+    measure_rates(single);
+    set_adc_mode(ADC_MODE_SEQUENCE);
+    CHECK(carrier[1] >= SEQUENCE_GAIN_MIN * single[1], "full rounds: sequence %.0f/s, single %.0f/s",
+          carrier[1], single[1]);
+    CHECK(moving[3] >= MOVING_GAIN_MIN * carrier[3], "moving pot %.0f/s, full rounds %.0f/s", moving[3],
+          carrier[3]);
+
+    printf("adc_sequence: full round %.0f/s in sequences, %.0f/s single; idle pots %.0f/s; "
+           "moving pot %.0f/s, %.1fx the full rounds\n", carrier[1], single[1], idle[2], moving[3],
+           moving[3] / carrier[3]);
+    return TEST_RESULT("test_adc_sequence");
+}
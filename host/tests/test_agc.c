@@ -0,0 +1,99 @@
+/*
+ * File: test_agc.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the digipot back off on over range conversions.
+ *              digipot_back_off() is called as the ADC interrupt would for FWD and
+ *              REF over range in one sequence, while the write is still on the SPI
+ *              bus and for a conversion started at the old gain. Only the first may
+ *              halve the gain. The carrier is then stepped up 20 dB while the
+ *              firmware runs, and the gain must come down in halvings, one per gain
+ *              epoch, without dropping below what the new level needs.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define SETTLE_S                    0.5
+#define STEP_S                      0.0001
+#define OVERLOAD_S                  0.2
+#define LOW_POWER_W                 15.0
+#define HIGH_POWER_W                1500.0
+#define MAX_WRITES                  16
+
+
+extern uint8_t DATA_BYTE;
+
+
+// Code one back off moves to from the given code.
+static uint8_t halved(uint8_t code)
+{
+    return code + ((AGC_CODE_MAX + 1 - code + 1) >> 1);
+}
+
+
+int main(void)
+{
+    static const sim_load_t matched = { .model = SIM_LOAD_FIXED, .r = 50.0, .x = 0.0 };
+    sim_options_t options = {0};
+    uint8_t code, epoch, writes[MAX_WRITES];
+    double elapsed;
+    int count = 0, i;
+
+    options.seed = 1;
+    sim_reset(&options);
+    sim_power_up();
+    sim_run(SETTLE_S);
+
+    // FWD and REF over range in one sequence back off once
+    code = DATA_BYTE;
+    epoch = agc_epoch;
+    seq_gain_epoch = agc_epoch;
+    digipot_back_off();
+    CHECK(DATA_BYTE == halved(code), "code %u after a back off from %u", DATA_BYTE, code);
+    CHECK(spi_busy, "back off not written");
+    digipot_back_off();
+    CHECK(DATA_BYTE == halved(code), "second back off while the first is written, code %u", DATA_BYTE);
+
+    // A conversion started before the new gain reached the wiper is ignored
+    sim_run(0.001);
+    CHECK(!spi_busy && (agc_epoch == (uint8_t)(epoch + 1)), "write not complete");
+    CHECK(sim_hw.wiper == halved(code), "wiper at %u", sim_hw.wiper);
+    seq_gain_epoch = epoch;
+    digipot_back_off();
+    CHECK(DATA_BYTE == halved(code), "back off from a conversion at the old gain, code %u", DATA_BYTE);
+    seq_gain_epoch = agc_epoch;
+    digipot_back_off();
+    CHECK(DATA_BYTE == halved(halved(code)), "no back off at the new gain, code %u", DATA_BYTE);
+
+    // Overload from a carrier stepped up 20 dB, the codes written are single halvings
+    sim_set_load(&matched);
+    sim_key(14.2e6, LOW_POWER_W);
+    sim_run(SETTLE_S);
+    CHECK(agc_locked, "no lock at %.0f W", LOW_POWER_W);
+    code = sim_hw.wiper;
+    writes[count++] = code;
+    sim_key(14.2e6, HIGH_POWER_W);
+    for(elapsed = 0.0; (elapsed < OVERLOAD_S) && (count < MAX_WRITES); elapsed += STEP_S)
+    {
+        sim_run(STEP_S);
+        if(sim_hw.wiper != writes[count - 1]) { writes[count++] = sim_hw.wiper; }
+    }
+    sim_run(SETTLE_S);
+    CHECK(agc_locked, "no lock at %.0f W", HIGH_POWER_W);
+    CHECK(count >= 2, "no back off at %.0f W", HIGH_POWER_W);
+    for(i = 1; (i < count) && (writes[i] > writes[i - 1]); i++) {
+        CHECK(writes[i] == halved(writes[i - 1]), "back off from %u to %u", writes[i - 1], writes[i]);
+    }
+    CHECK((AGC_CODE_MAX + 1 - writes[i - 1]) * 10.0 >= (AGC_CODE_MAX + 1 - code) / 2.0,
+          "gain cut to %u from %u for a 20 dB step", writes[i - 1], code);
+
+    printf("agc: 20 dB step backed off from code %u to %u in %d halvings, settled at %u\n", code,
+           writes[i - 1], i - 1, sim_hw.wiper);
+    return TEST_RESULT("test_agc");
+}
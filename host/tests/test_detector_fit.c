@@ -0,0 +1,172 @@
+/*
+ * File: test_detector_fit.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the detector linearization and its fit. Calibration
+ *              points are recorded from a diode detector model, square law at low
+ *              voltage and linear at high, with a different knee on each channel.
+ *              They go through a calibration file, the fit and set_detector_point()
+ *              into the firmware's tables. Reflection coefficients found through
+ *              linearize_detector() at voltages between the calibration points must
+ *              then match the true ones, where the identity tables are far off. REF
+ *              voltages below the calibrated range are left out, there the diode
+ *              output is under one ADC count.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define CAL_POINTS                  48      // Per channel
+#define CAL_MIN_V                   0.04
+#define CAL_MAX_V                   1.5
+#define FWD_KNEE_V                  0.05    // Diode knee of each channel
+#define REF_KNEE_V                  0.07
+#define COUNTS_PER_V                (ADC_HIRES(SIM_ADC_FULL_SCALE) / SIM_ADC_VREF)
+#define FIT_ERROR_MAX               0.02    // Relative, over the calibration points
+#define GAMMA_ERROR_MAX             0.02
+#define GAMMA_ERROR_IDENTITY_MIN    0.1     // The identity tables must be this far off
+
+
+static const double knee_v[2] = { FWD_KNEE_V, REF_KNEE_V };
+
+
+// Detector output voltage for a true RF voltage.
+static double diode(uint8_t channel, double volts)
+{
+    return sqrt(volts * volts + knee_v[channel] * knee_v[channel]) - knee_v[channel];
+}
+
+
+// Digipot code the AGC would settle on for a FWD voltage, aiming at AGC_TARGET.
+static uint8_t agc_code(double fwd_volts)
+{
+    double span = (AGC_CODE_MAX + 1) * ADC_HIRES(AGC_TARGET) / (diode(DET_FWD, fwd_volts) * COUNTS_PER_V);
+
+    if(span >= AGC_CODE_MAX + 1) { return 0; }
+    return AGC_CODE_MAX + 1 - (uint8_t)ceil(span);
+}
+
+
+// Published reading of a channel for a true RF voltage at a digipot code.
+static uint16_t reading(uint8_t channel, double volts, uint8_t code)
+{
+    double counts = diode(channel, volts) * COUNTS_PER_V * (AGC_CODE_MAX + 1 - code) / (AGC_CODE_MAX + 1);
+
+    return (counts > ADC_HIRES(SIM_ADC_FULL_SCALE)) ? ADC_HIRES(SIM_ADC_FULL_SCALE) : (uint16_t)lround(counts);
+}
+
+
+// Record calibration points for both channels into a file and read them back.
+static int record_calibration(sim_det_point_t *points, int max_points)
+{
+    char path[] = "/tmp/test_detector_fitXXXXXX";
+    FILE *file;
+    double volts;
+    uint8_t channel, code;
+    int i, fd, count;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0, "no temporary file for the calibration");
+    if(fd < 0) { return 0; }
+    file = fdopen(fd, "w");
+    fprintf(file, "! channel, gain code, reading, volts\n");
+    for(channel = DET_FWD; channel <= DET_REF; channel++)
+    {
+        for(i = 0; i < CAL_POINTS; i++)
+        {
+            volts = CAL_MIN_V * pow(CAL_MAX_V / CAL_MIN_V, i / (CAL_POINTS - 1.0));
+            code = agc_code(volts);
+            fprintf(file, "%s %u %u %.6f ! %.1f %% gain\n", (channel == DET_FWD) ? "fwd" : "ref", code,
+                    reading(channel, volts, code), volts, 100.0 * (AGC_CODE_MAX + 1 - code) / (AGC_CODE_MAX + 1));
+        }
+    }
+    fclose(file);
+    count = sim_read_calibration(path, points, max_points);
+    unlink(path);
+    CHECK(count == 2 * CAL_POINTS, "%d calibration points read back, %d written", count, 2 * CAL_POINTS);
+    return count;
+}
+
+
+// Worst reflection coefficient error through the firmware's tables, at FWD
+// voltages between the calibration points.
+static double worst_gamma_error(void)
+{
+    static const double gammas[] = { 0.05, 0.1, 0.2, 0.33, 0.5, 0.7, 0.9 };
+    double fwd_volts, error, worst = 0.0;
+    uint32_t ref;
+    _iq16 gamma;
+    uint8_t code, i;
+    int step;
+
+    for(step = 0; step < CAL_POINTS - 1; step++)
+    {
+        fwd_volts = 0.1 * pow(CAL_MAX_V / 0.1, (step + 0.5) / (CAL_POINTS - 1.0));
+        code = agc_code(fwd_volts);
+        for(i = 0; i < sizeof(gammas) / sizeof(gammas[0]); i++)
+        {
+            if(gammas[i] * fwd_volts < CAL_MIN_V) { continue; } // REF below the calibration
+            ref = linearize_detector(DET_REF, reading(DET_REF, gammas[i] * fwd_volts, code), code);
+            gamma = reflection_ratio(ref, linearize_detector(DET_FWD, reading(DET_FWD, fwd_volts, code), code));
+            error = fabs(gamma / 65536.0 - gammas[i]);
+            if(error > worst) { worst = error; }
+        }
+    }
+    return worst;
+}
+
+
+int main(void)
+{
+    static sim_det_point_t points[4 * CAL_POINTS];
+    uint32_t table[2][DET_TABLE_POINTS];
+    double scale, fit_error[2], identity_error, fitted_error;
+    uint8_t channel, i;
+    int count;
+
+    count = record_calibration(points, sizeof(points) / sizeof(points[0]));
+    scale = sim_detector_scale(points, count);
+    CHECK(scale > 0.0, "no scale from the calibration");
+    identity_error = worst_gamma_error();
+
+    for(channel = DET_FWD; channel <= DET_REF; channel++)
+    {
+        CHECK(sim_fit_detector(points, count, channel, scale, table[channel]) == CAL_POINTS,
+              "channel %u: not every point used", channel);
+        fit_error[channel] = sim_detector_fit_error(points, count, channel, scale, table[channel]);
+        CHECK(fit_error[channel] < FIT_ERROR_MAX, "channel %u: fit error %.2f %%", channel,
+              100.0 * fit_error[channel]);
+        for(i = 1; i < DET_TABLE_POINTS; i++) {
+            CHECK(table[channel][i] > table[channel][i - 1], "channel %u: table falls at entry %u", channel, i);
+        }
+    }
+
+    // Install the tables as the target would, with the FRAM left protected
+    SYSCFG0 = FRWPPW | PFWP;
+    for(channel = DET_FWD; channel <= DET_REF; channel++)
+    {
+        for(i = 0; i < DET_TABLE_POINTS; i++) { set_detector_point(channel, i, table[channel][i]); }
+    }
+    CHECK(SYSCFG0 & PFWP, "program FRAM left writable");
+    CHECK(memcmp(detector_table, table, sizeof(table)) == 0, "tables not installed");
+    set_detector_point(DET_FWD, DET_TABLE_POINTS, 1);
+    set_detector_point(DET_REF + 1, 0, 1);
+    CHECK(memcmp(detector_table, table, sizeof(table)) == 0, "point outside the tables written");
+
+    fitted_error = worst_gamma_error();
+    CHECK(identity_error > GAMMA_ERROR_IDENTITY_MIN, "identity tables only %.3f off, the model is too linear",
+          identity_error);
+    CHECK(fitted_error < GAMMA_ERROR_MAX, "|G| off by %.3f through the fitted tables", fitted_error);
+
+    printf("detector_fit: fit error %.2f %% FWD, %.2f %% REF; worst |G| error %.3f fitted, %.3f identity\n",
+           100.0 * fit_error[DET_FWD], 100.0 * fit_error[DET_REF], fitted_error, identity_error);
+    return TEST_RESULT("test_detector_fit");
+}
@@ -0,0 +1,176 @@
+/*
+ * File: test_freq_counter.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the reciprocal frequency counter against the Timer1
+ *              and Timer3 models. The carrier is keyed across 1.8 - 54 MHz and the
+ *              counter must read within one Timer0 tick per gate, with gates of at
+ *              least half of FREQ_GATE_TICKS. It must also acquire quickly, follow
+ *              a change of band without blending the two frequencies and report no
+ *              signal once the carrier is removed. A single gate beyond the
+ *              hysteresis must not move the frequency, however often it is read,
+ *              and two must even when they arrive together. The settings menu must step the
+ *              hysteresis within its range.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define SWEEP_POINTS                48
+#define SWEEP_MIN_HZ                1.8e6
+#define SWEEP_MAX_HZ                54.0e6
+#define SETTLE_S                    0.3
+#define STEP_S                      0.001
+#define ACQUIRE_MAX_S               0.1   // Keyed to a reading within tolerance
+#define BAND_CHANGE_MAX_S           0.15  // Change of band to a reading within tolerance
+#define SIGNAL_LOST_MAX_S           0.15  // Carrier removed to frequency 0
+#define TICK_S                      (1.0 / FREQ_TIMEBASE_HZ)
+#define MIN_GATE_S                  (FREQ_GATE_TICKS / 2 * TICK_S)
+
+
+extern volatile freq_record_t freq_history[FREQ_HISTORY_SIZE];
+extern volatile uint8_t freq_history_head;
+extern uint32_t freq_latest;
+
+
+// One Timer0 tick over the shortest full length gate, plus rounding.
+// Append a gate to the history as the Timer1 interrupt does, reading the base
+// gate's frequency times ratio.
+static void push_gate(const freq_record_t *base, double ratio)
+{
+    volatile freq_record_t *record = &freq_history[freq_history_head];
+
+    record->timestamp = base->timestamp;
+    record->ticks = base->ticks;
+    record->edges = (uint16_t)lround(base->edges * ratio);
+    freq_history_head = (freq_history_head + 1) & (FREQ_HISTORY_SIZE - 1);
+}
+
+
+static double tolerance_hz(double freq_hz)
+{
+    return freq_hz * TICK_S / MIN_GATE_S + 1.0;
+}
+
+
+static uint8_t reads(double freq_hz)
+{
+    return fabs((double)frequency - freq_hz) <= tolerance_hz(freq_hz);
+}
+
+
+// Run until the counter reads freq_hz, or the limit. Returns the time taken.
+static double time_to_read(double freq_hz, double limit)
+{
+    double start = sim_now;
+
+    while(!reads(freq_hz) && (sim_now - start < limit)) { sim_run(STEP_S); }
+    return sim_now - start;
+}
+
+
+int main(void)
+{
+    static const double bands_hz[] = { 1.838e6, 3.573e6, 5.357e6, 7.074e6, 10.136e6, 14.074e6,
+                                       18.100e6, 21.074e6, 24.915e6, 28.074e6, 50.313e6, 53.990e6 };
+    sim_options_t options = {0};
+    volatile freq_record_t *record;
+    freq_record_t base;
+    double freq_hz, elapsed, old_hz, new_hz;
+    uint8_t i, blended = 0;
+
+    options.seed = 1;
+    sim_reset(&options);
+    sim_power_up();
+    sim_run(SETTLE_S);
+
+    // Accuracy and gate length over the range, at log spaced points and band frequencies
+    for(i = 0; i < SWEEP_POINTS + sizeof(bands_hz) / sizeof(bands_hz[0]); i++)
+    {
+        freq_hz = (i < SWEEP_POINTS) ? SWEEP_MIN_HZ * pow(SWEEP_MAX_HZ / SWEEP_MIN_HZ, i / (SWEEP_POINTS - 1.0))
+                                     : bands_hz[i - SWEEP_POINTS];
+        freq_hz = floor(freq_hz);
+        sim_key(freq_hz, 100.0);
+        elapsed = time_to_read(freq_hz, ACQUIRE_MAX_S);
+        CHECK(elapsed < ACQUIRE_MAX_S, "%.0f Hz: not read within %.0f ms, reads %lu",
+              freq_hz, ACQUIRE_MAX_S * 1000.0, (unsigned long)frequency);
+        sim_run(SETTLE_S);
+
+        record = &freq_history[(freq_history_head - 1) & (FREQ_HISTORY_SIZE - 1)];
+        CHECK(fabs((double)frequency - freq_hz) <= tolerance_hz(freq_hz),
+              "%.0f Hz: smoothed reading %lu", freq_hz, (unsigned long)frequency);
+        CHECK(fabs((double)freq_latest - freq_hz) <= tolerance_hz(freq_hz),
+              "%.0f Hz: latest gate reads %lu", freq_hz, (unsigned long)freq_latest);
+        CHECK((record->ticks >= FREQ_GATE_TICKS / 2) && (record->ticks <= FREQ_GATE_TICKS),
+              "%.0f Hz: gate of %.1f ms", freq_hz, record->ticks * TICK_S * 1000.0);
+
+        sim_unkey();
+        elapsed = 0.0;
+        while((frequency != 0) && (elapsed < SIGNAL_LOST_MAX_S)) { sim_run(STEP_S); elapsed += STEP_S; }
+        CHECK(frequency == 0, "%.0f Hz: still reads %lu after the carrier was removed",
+              freq_hz, (unsigned long)frequency);
+        sim_run(SETTLE_S);
+    }
+
+    // Change of band with the carrier held, every reading on the way is one or the other
+    old_hz = 7.074e6;
+    new_hz = 14.074e6;
+    sim_key(old_hz, 100.0);
+    sim_run(SETTLE_S);
+    CHECK(reads(old_hz), "reads %lu before the change of band", (unsigned long)frequency);
+    sim_key(new_hz, 100.0);
+    elapsed = 0.0;
+    while(!reads(new_hz) && (elapsed < BAND_CHANGE_MAX_S))
+    {
+        if(!reads(old_hz)) { blended = 1; }
+        sim_run(STEP_S);
+        elapsed += STEP_S;
+    }
+    CHECK(reads(new_hz), "reads %lu %.0f ms after the change of band", (unsigned long)frequency,
+          BAND_CHANGE_MAX_S * 1000.0);
+    CHECK(!blended, "a reading between the two bands was reported");
+
+    // Gates beyond the hysteresis count once each, however often measure_freq() runs
+    sim_run(SETTLE_S);
+    base = freq_history[(freq_history_head - 1) & (FREQ_HISTORY_SIZE - 1)];
+    old_hz = (double)frequency;
+    push_gate(&base, 0.99);
+    measure_freq();
+    measure_freq();
+    measure_freq();
+    CHECK(reads(new_hz), "one glitch gate moved the frequency to %lu", (unsigned long)frequency);
+    push_gate(&base, 1.0);
+    measure_freq();
+    CHECK(reads(new_hz), "reads %lu after the glitch", (unsigned long)frequency);
+    push_gate(&base, 0.99);
+    push_gate(&base, 1.0);
+    push_gate(&base, 0.99);
+    measure_freq();
+    CHECK(reads(new_hz), "glitch gates apart moved the frequency to %lu", (unsigned long)frequency);
+    push_gate(&base, 1.0);
+    measure_freq();
+    push_gate(&base, 0.99);
+    push_gate(&base, 0.99);
+    measure_freq();
+    CHECK(fabs(frequency - 0.99 * old_hz) < 0.001 * old_hz, "two new gates beyond the hysteresis read %lu",
+          (unsigned long)frequency);
+
+    // The settings menu steps the hysteresis by 1 kHz and holds it in range
+    SYSCFG0 = FRWPPW | PFWP;
+    display_menu = FREQ_HYSTERESIS;
+    adjust_setting(1);
+    CHECK(freq_hysteresis == FREQ_HYSTERESIS_DEFAULT + 1, "hysteresis %u kHz after a step up", freq_hysteresis);
+    for(i = 0; i < FREQ_HYSTERESIS_MAX; i++) { adjust_setting(1); }
+    CHECK(freq_hysteresis == FREQ_HYSTERESIS_MAX, "hysteresis %u kHz above its range", freq_hysteresis);
+    for(i = 0; i < FREQ_HYSTERESIS_MAX; i++) { adjust_setting(-1); }
+    CHECK(freq_hysteresis == FREQ_HYSTERESIS_MIN, "hysteresis %u kHz below its range", freq_hysteresis);
+    CHECK(SYSCFG0 & PFWP, "program FRAM left writable");
+
+    return TEST_RESULT("test_freq_counter");
+}
@@ -0,0 +1,177 @@
+/*
+ * File: test_interpolation.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the prediction error of tune_memory_interpolate().
+ *              For antennas swept across a band, the exact L-network is worked out
+ *              in double precision at two stored frequencies and at every 25 kHz
+ *              bin between them. The VSWR the predicted positions give through the
+ *              simulated network is compared with recalling the nearer stored
+ *              solution unchanged, and must not be worse. The worst position error
+ *              is reported only. Near resonance it can be large without harm, the
+ *              network then barely changes the match whatever its setting.
+ *
+ *              The spans are about the widest the tune memory accepts. Dipoles
+ *              stored 300 kHz apart on 80 m, or 100 kHz apart on 160 m, predict
+ *              worse than the nearer neighbour. That sets the span limit, with a
+ *              factor of two in hand.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "intellitune.h"
+#include "sim.h"
+#include "tests/test.h"
+
+
+#define STEP_HZ                     (TUNE_MEM_BIN_KHZ * 1000.0)
+#define VSWR_MARGIN                 0.03 // Prediction may tie the neighbour within rounding
+
+
+typedef struct
+{
+    const char *name;
+    sim_load_t load;
+    double lo_hz, hi_hz;        // Stored neighbours
+} span_t;
+
+
+extern tune_solution_t tune_memory[TUNE_MEM_ENTRIES];
+extern uint8_t tune_memory_next;
+
+
+// Exact L-network for a load, as pot counts with the capacitance linearized across
+// the relays. The capacitor side follows the solver: output side above 50 ohms.
+static uint8_t exact_positions(double complex z_load, double freq_hz, double *cap, double *ind, uint8_t *side)
+{
+    double complex z = z_load / SOURCE_IMPEDANCE, y;
+    double r = creal(z), x = cimag(z), g, b, match, x_series, b_shunt, w = 2.0 * M_PI * freq_hz / 1e6;
+    uint8_t attempt;
+
+    *side = (r > 1.0) ? CAP_OUTPUT_SIDE : CAP_INPUT_SIDE;
+    for(attempt = 0; attempt < 2; attempt++)
+    {
+        if(*side == CAP_OUTPUT_SIDE) {
+            y = 1.0 / z;
+            g = creal(y);
+            b = cimag(y);
+            if(g > 1.0) { *side = CAP_INPUT_SIDE; continue; }
+            match = sqrt(g - g * g);
+            x_series = match / g;
+            b_shunt = match - b;
+        } else {
+            if(r > 1.0) { *side = CAP_OUTPUT_SIDE; continue; }
+            match = sqrt(r - r * r);
+            x_series = match - x;
+            b_shunt = match / r;
+        }
+        if((x_series >= 0.0) && (b_shunt >= 0.0)) { break; }
+        *side = (*side == CAP_OUTPUT_SIDE) ? CAP_INPUT_SIDE : CAP_OUTPUT_SIDE;
+    }
+    if(attempt == 2) { return 0; }
+
+    *ind = x_series * SOURCE_IMPEDANCE / w * (L_UPPER_LIMIT - L_LOWER_LIMIT) / 24.0;
+    *cap = b_shunt / (SOURCE_IMPEDANCE * w) * 1e6 * (C_UPPER_LIMIT - C_LOWER_LIMIT) / 500.0;
+    return (*ind <= L_UPPER_LIMIT) && (*cap <= 7 * C_RELAY_STEP + C_UPPER_LIMIT);
+}
+
+
+// Split a linearized capacitance into relays and varicap as the tune memory does.
+static tune_solution_t to_solution(double cap, double ind, uint8_t side)
+{
+    tune_solution_t solution = { .ind_position = (uint16_t)lround(ind), .net_side = side };
+    uint16_t counts = (uint16_t)lround(cap);
+
+    if(counts > C_VARICAP_MIN) { solution.relay_setting = (counts - C_VARICAP_MIN) / C_RELAY_STEP; }
+    if(solution.relay_setting > 7) { solution.relay_setting = 7; }
+    solution.cap_position = counts - solution.relay_setting * C_RELAY_STEP;
+    return solution;
+}
+
+
+static double linear_cap(const tune_solution_t *solution)
+{
+    return solution->relay_setting * (double)C_RELAY_STEP + solution->cap_position;
+}
+
+
+// VSWR of a load through the network the positions set.
+static double vswr_through(const tune_solution_t *solution, const sim_load_t *load, double freq_hz)
+{
+    sim_hw_t hw;
+
+    memset(&hw, 0, sizeof(hw));
+    hw.cap_position = solution->cap_position;
+    hw.ind_position = solution->ind_position;
+    hw.relays = solution->relay_setting;
+    hw.cap_input_side = (solution->net_side == CAP_INPUT_SIDE);
+    return sim_matched_vswr(freq_hz, sim_load_impedance(load, freq_hz), &hw);
+}
+
+
+int main(void)
+{
+    static span_t spans[] = {
+        { "fixed_25_-80", { .model = SIM_LOAD_FIXED, .r = 25.0, .x = -80.0 }, 10.100e6, 10.150e6 },
+        { "dipole_40m", { .model = SIM_LOAD_DIPOLE, .length = 20.1, .radius = 0.001 }, 7.000e6, 7.200e6 },
+        { "dipole_40m_on_30", { .model = SIM_LOAD_DIPOLE, .length = 20.1, .radius = 0.001 }, 10.100e6, 10.150e6 },
+        { "dipole_20m", { .model = SIM_LOAD_DIPOLE, .length = 10.1, .radius = 0.001 }, 14.000e6, 14.350e6 },
+        { "dipole_80m_low", { .model = SIM_LOAD_DIPOLE, .length = 39.5, .radius = 0.001 }, 3.500e6, 3.600e6 },
+        { "dipole_80m_high", { .model = SIM_LOAD_DIPOLE, .length = 39.5, .radius = 0.001 }, 3.700e6, 3.800e6 },
+        { "dipole_160m", { .model = SIM_LOAD_DIPOLE, .length = 78.0, .radius = 0.001 }, 1.800e6, 1.850e6 },
+        { "dipole_80m_on_60", { .model = SIM_LOAD_DIPOLE, .length = 39.5, .radius = 0.001 }, 5.330e6, 5.405e6 },
+        { "vertical_20m", { .model = SIM_LOAD_MONOPOLE, .length = 5.1, .radius = 0.002, .loss = 12.0 },
+          14.000e6, 14.350e6 },
+        { "vertical_40m_short", { .model = SIM_LOAD_MONOPOLE, .length = 6.0, .radius = 0.002, .loss = 15.0 },
+          7.000e6, 7.200e6 },
+        { "whip_10m", { .model = SIM_LOAD_MONOPOLE, .length = 2.0, .radius = 0.003, .loss = 8.0 },
+          28.000e6, 28.500e6 },
+    };
+    tune_solution_t lo, hi, predicted, nearest;
+    double cap, ind, freq_hz, vswr_predicted, vswr_nearest, error, error_max = 0.0;
+    double sum_predicted = 0.0, sum_nearest = 0.0, excess_max = -1.0;
+    uint8_t i, side, lo_side, hi_side;
+    int points = 0;
+
+    for(i = 0; i < sizeof(spans) / sizeof(spans[0]); i++)
+    {
+        memset(tune_memory, 0, sizeof(tune_memory));
+        tune_memory_next = 0;
+        CHECK(exact_positions(sim_load_impedance(&spans[i].load, spans[i].lo_hz), spans[i].lo_hz,
+                              &cap, &ind, &lo_side), "%s: no network at the lower point", spans[i].name);
+        lo = to_solution(cap, ind, lo_side);
+        CHECK(exact_positions(sim_load_impedance(&spans[i].load, spans[i].hi_hz), spans[i].hi_hz,
+                              &cap, &ind, &hi_side), "%s: no network at the upper point", spans[i].name);
+        hi = to_solution(cap, ind, hi_side);
+        CHECK(lo_side == hi_side, "%s: network side changes across the span", spans[i].name);
+        tune_memory_store((uint32_t)spans[i].lo_hz, &lo);
+        tune_memory_store((uint32_t)spans[i].hi_hz, &hi);
+
+        for(freq_hz = spans[i].lo_hz + STEP_HZ; freq_hz < spans[i].hi_hz - STEP_HZ / 2; freq_hz += STEP_HZ)
+        {
+            if(!exact_positions(sim_load_impedance(&spans[i].load, freq_hz), freq_hz, &cap, &ind, &side)) { continue; }
+            CHECK(tune_memory_interpolate((uint32_t)freq_hz, &predicted), "%s at %.3f MHz: no prediction",
+                  spans[i].name, freq_hz / 1e6);
+
+            error = fmax(fabs(predicted.ind_position - ind), fabs(linear_cap(&predicted) - cap));
+            if(error > error_max) { error_max = error; }
+
+            nearest = (freq_hz - spans[i].lo_hz < spans[i].hi_hz - freq_hz) ? lo : hi;
+            vswr_predicted = vswr_through(&predicted, &spans[i].load, freq_hz);
+            vswr_nearest = vswr_through(&nearest, &spans[i].load, freq_hz);
+            CHECK(vswr_predicted <= vswr_nearest + VSWR_MARGIN, "%s at %.3f MHz: VSWR %.2f, nearest stored %.2f",
+                  spans[i].name, freq_hz / 1e6, vswr_predicted, vswr_nearest);
+            if(vswr_predicted - vswr_nearest > excess_max) { excess_max = vswr_predicted - vswr_nearest; }
+            sum_predicted += vswr_predicted;
+            sum_nearest += vswr_nearest;
+            points++;
+        }
+    }
+
+    printf("interpolation: %d points, mean VSWR %.2f predicted, %.2f nearest, worst excess %.2f, "
+           "worst position error %.0f counts\n", points, sum_predicted / points, sum_nearest / points, excess_max,
+           error_max);
+    return TEST_RESULT("test_interpolation");
+}
@@ -0,0 +1,152 @@
+/*
+ * File: test_solver.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of solve_load_impedance(). Reflection magnitudes are
+ *              computed in double precision for known loads, with and without a
+ *              network in front of them, and the solver must recover the load and
+ *              give a network that matches it. Every candidate it calls valid must
+ *              be buildable, including for loads whose network would overflow the
+ *              Q16 scaling to uH and pF.
+ *
+ ******************************************************************************/
+
+#include <complex.h>
+#include <math.h>
+#include "intellitune.h"
+#include "tests/test.h"
+
+
+#define Z0                          SOURCE_IMPEDANCE
+#define MATCH_GAMMA_MAX             0.1   // Reflection through the candidate network
+#define LOAD_TOLERANCE              0.03  // Recovered load, fraction of |Z| + 1 ohm
+
+
+static double gamma_of(double complex z)
+{
+    return cabs((z - Z0) / (z + Z0));
+}
+
+
+// Impedance at the input of a lossless L-network in front of z_load.
+static double complex network_input(double complex z_load, double freq_hz, double uh, double pf, uint8_t side)
+{
+    double w = 2.0 * M_PI * freq_hz;
+    double complex z_series = I * w * uh * 1e-6, y_shunt = I * w * pf * 1e-12;
+
+    if(side == CAP_INPUT_SIDE) {
+        z_load += z_series;
+        return z_load / (1.0 + z_load * y_shunt);
+    }
+    return z_load / (1.0 + z_load * y_shunt) + z_series;
+}
+
+
+// Component values the firmware assumes for a set of positions.
+static void network_values(const tune_solution_t *network, double *uh, double *pf)
+{
+    *pf = network->cap_position * 500.0 / (C_UPPER_LIMIT - C_LOWER_LIMIT) + network->relay_setting * 470.0;
+    *uh = network->ind_position * 24.0 / (L_UPPER_LIMIT - L_LOWER_LIMIT);
+}
+
+
+// Solve for the load seen at z_input and return the number of valid candidates.
+static uint8_t solve(double complex z_input, double freq_hz, const tune_solution_t *network, load_solution_t *load)
+{
+    _iq16 gamma_out = _IQ16(gamma_of(z_input));
+    _iq16 gamma_in = _IQ16(gamma_of(z_input + KNOWN_IMPEDANCE));
+
+    return solve_load_impedance(gamma_out, gamma_in, FREQ_HZ_TO_OMEGA((uint32_t)freq_hz), network, load);
+}
+
+
+// Every valid candidate must be inside the component ranges.
+static void check_candidates(const load_solution_t *load, const char *name)
+{
+    uint8_t i;
+
+    for(i = 0; i < 2; i++)
+    {
+        if(!load->valid[i]) { continue; }
+        CHECK((load->inductance[i] >= 0) && (load->inductance[i] <= _IQ16(IND_MAX)),
+              "%s candidate %u: %.2f uH", name, i, load->inductance[i] / 65536.0);
+        CHECK((load->capacitance[i] >= 0) && (load->capacitance[i] <= _IQ16(CAP_MAX)),
+              "%s candidate %u: %.1f pF", name, i, load->capacitance[i] / 65536.0);
+    }
+}
+
+
+// Solve a load, directly or through a network, and check the result.
+static void check_load(const char *name, double complex z_load, double freq_hz, const tune_solution_t *network)
+{
+    load_solution_t load;
+    double complex z_input = z_load, z_matched;
+    double uh, pf, tolerance = LOAD_TOLERANCE * cabs(z_load) + 1.0;
+    uint8_t candidate;
+
+    if(network != NULL)
+    {
+        network_values(network, &uh, &pf);
+        z_input = network_input(z_load, freq_hz, uh, pf, network->net_side);
+    }
+    // Candidates follow the sign of the reactance measured at the input, and the
+    // load is reported as candidate 0 sees it
+    candidate = (cimag(z_input) >= 0) ? 0 : 1;
+    CHECK(solve(z_input, freq_hz, network, &load) > 0, "%s: no candidate", name);
+    check_candidates(&load, name);
+    if((candidate == 0) || (network == NULL))
+    {
+        CHECK(fabs(load.resistance / 65536.0 - creal(z_load)) < tolerance,
+              "%s: R %.2f, expected %.2f", name, load.resistance / 65536.0, creal(z_load));
+        CHECK(fabs(load.reactance / 65536.0 - fabs(cimag(z_load))) < tolerance,
+              "%s: |X| %.2f, expected %.2f", name, load.reactance / 65536.0, fabs(cimag(z_load)));
+    }
+
+    if((cimag(z_input) == 0.0) && !load.valid[0]) { candidate = 1; }
+    CHECK(load.valid[candidate], "%s: candidate for the true sign not valid", name);
+    if(!load.valid[candidate]) { return; }
+    z_matched = network_input(z_load, freq_hz, load.inductance[candidate] / 65536.0,
+                              load.capacitance[candidate] / 65536.0, load.net_side[candidate]);
+    CHECK(gamma_of(z_matched) < MATCH_GAMMA_MAX, "%s: |G| %.3f through the network", name, gamma_of(z_matched));
+}
+
+
+int main(void)
+{
+    static const struct { const char *name; double r, x, mhz; } loads[] = {
+        { "matched", 50.0, 0.0, 14.2 },
+        { "low_r", 12.5, 0.0, 3.6 },
+        { "high_r", 200.0, 0.0, 7.1 },
+        { "capacitive", 25.0, -80.0, 10.1 },
+        { "inductive", 100.0, 120.0, 18.1 },
+        { "high_r_6m", 300.0, 150.0, 50.2 },
+        { "low_r_160m", 15.0, -60.0, 1.85 },
+    };
+    tune_solution_t network = { .cap_position = 1200, .ind_position = 800, .relay_setting = 1,
+                                .net_side = CAP_OUTPUT_SIDE };
+    load_solution_t load;
+    uint8_t i;
+
+    for(i = 0; i < sizeof(loads) / sizeof(loads[0]); i++)
+    {
+        check_load(loads[i].name, loads[i].r + I * loads[i].x, loads[i].mhz * 1e6, NULL);
+    }
+
+    // Measured through the network left by the last tune
+    check_load("through_output_side", 100.0 + I * 120.0, 14.2e6, &network);
+    network.net_side = CAP_INPUT_SIDE;
+    network.relay_setting = 0;
+    check_load("through_input_side", 12.5 - I * 20.0, 7.1e6, &network);
+
+    // Far out of range. Scaled to uH and pF these overflow Q16 and used to wrap
+    // to negative values that passed the range check.
+    solve(0.1 - I * 5.0, 1.8e6, NULL, &load);
+    check_candidates(&load, "tiny_r_160m");
+    solve(0.05 + I * 0.5, 1.8e6, NULL, &load);
+    check_candidates(&load, "tiny_r_ind_160m");
+    solve(20.0 - I * 30.0, 1000.0, NULL, &load);
+    check_candidates(&load, "audio_frequency");
+
+    return TEST_RESULT("test_solver");
+}
@@ -0,0 +1,94 @@
+/*
+ * File: test_swr_math.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the division free reflection coefficient and VSWR
+ *              against the IQmath path they replaced, _IQ19div of REF by FWD and
+ *              _IQ16div of (1 + G) by (1 - G). Detector values are swept across
+ *              the full range of linearize_detector() outputs, and reflection
+ *              coefficients from 0 to total reflection. Both results must stay
+ *              within the reciprocal table's error of IQmath, VSWR must never fall
+ *              as G rises, and the edge cases must saturate rather than wrap.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include "intellitune.h"
+#include "tests/test.h"
+
+
+#define FWD_STEPS                   97      // Log spaced FWD values from 2^4 to 2^24
+#define GAMMA_STEPS                 1000
+#define GAMMA_RELATIVE_MAX          0.0003  // Reciprocal table, relative
+#define GAMMA_LSB_MAX               2       // Plus truncation of the normalized operands
+#define GAMMA_REPORT_MIN            _IQ16(0.01) // Relative error reported above this, LSBs dominate below
+#define VSWR_RELATIVE_MAX           0.0005
+#define VSWR_CHECK_MAX              1000.0  // Relative check up to this VSWR, saturation above
+
+
+// The IQmath reflection coefficient calculate_ref_coeff() used before.
+static _iq16 gamma_iqmath(uint32_t ref, uint32_t fwd)
+{
+    return _IQ19toIQ(_IQ19div((_iq19)ref, (_iq19)fwd));
+}
+
+
+// The IQmath VSWR update_swr() and tune() used before.
+static _iq16 vswr_iqmath(_iq16 gamma)
+{
+    return _IQ16div(_IQ16(1.0) + gamma, _IQ16(1.0) - gamma);
+}
+
+
+int main(void)
+{
+    uint32_t fwd, ref;
+    _iq16 gamma, expected, vswr, last_vswr;
+    double error, gamma_worst = 0.0, vswr_worst = 0.0;
+    int i, j;
+
+    for(i = 0; i < FWD_STEPS; i++)
+    {
+        fwd = (uint32_t)lround(16.0 * pow(2.0, 20.0 * i / (FWD_STEPS - 1.0)));
+        for(j = 0; j < GAMMA_STEPS; j++)
+        {
+            ref = (uint32_t)((uint64_t)fwd * j / GAMMA_STEPS);
+            gamma = reflection_ratio(ref, fwd);
+            expected = gamma_iqmath(ref, fwd);
+            error = fabs((double)gamma - expected);
+            CHECK(error <= GAMMA_RELATIVE_MAX * expected + GAMMA_LSB_MAX,
+                  "G %lu / %lu: %ld, IQmath %ld", (unsigned long)ref, (unsigned long)fwd, (long)gamma, (long)expected);
+            if(expected >= GAMMA_REPORT_MIN) { gamma_worst = fmax(gamma_worst, error / expected); }
+        }
+    }
+    CHECK(reflection_ratio(100, 0) == 0, "G with no FWD");
+    CHECK(reflection_ratio(5000, 5000) == _IQ16(1.0) - 1, "G of a total reflection");
+    CHECK(reflection_ratio(6000, 5000) == _IQ16(1.0) - 1, "G with REF above FWD");
+    CHECK(reflection_ratio(0xFFFFFFFF, 0xFFFFFFFF) == _IQ16(1.0) - 1, "G at full scale");
+    gamma = reflection_ratio(0x7FFFFFFF, 0xFFFFFFFF);
+    CHECK(labs(gamma - _IQ16(0.5)) <= GAMMA_RELATIVE_MAX * _IQ16(0.5) + GAMMA_LSB_MAX,
+          "G of one half at full scale, %ld", (long)gamma);
+
+    last_vswr = vswr_from_gamma(0);
+    CHECK(last_vswr == _IQ16(1.0), "VSWR of a match");
+    for(gamma = 0; gamma < _IQ16(1.0); gamma++)
+    {
+        vswr = vswr_from_gamma(gamma);
+        CHECK(vswr >= last_vswr, "VSWR falls from %ld to %ld at G %ld", (long)last_vswr, (long)vswr, (long)gamma);
+        last_vswr = vswr;
+        if(vswr_iqmath(gamma) > _IQ16(VSWR_CHECK_MAX)) { continue; }
+        error = fabs((double)vswr - vswr_iqmath(gamma)) / vswr_iqmath(gamma);
+        CHECK(error <= VSWR_RELATIVE_MAX, "VSWR at G %ld: %ld, IQmath %ld", (long)gamma, (long)vswr,
+              (long)vswr_iqmath(gamma));
+        vswr_worst = fmax(vswr_worst, error);
+    }
+    CHECK(vswr_from_gamma(_IQ16(1.0) - 1) == VSWR_MAX, "VSWR next to total reflection");
+    CHECK(vswr_from_gamma(_IQ16(1.0)) == VSWR_MAX, "VSWR of a total reflection");
+    CHECK(vswr_from_gamma(-100) == _IQ16(1.0), "VSWR of a negative G");
+
+    printf("swr_math: worst error against IQmath %.4f %% G above 0.01, %.4f %% VSWR up to %.0f:1\n",
+           100.0 * gamma_worst, 100.0 * vswr_worst, VSWR_CHECK_MAX);
+    return TEST_RESULT("test_swr_math");
+}
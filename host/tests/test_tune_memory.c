@@ -0,0 +1,170 @@
+/*
+ * File: test_tune_memory.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Host test of the tune memory table. The table lives in ordinary
+ *              memory here and SYSCFG0 is the register shim's, so store, recall,
+ *              replacement, clearing a bin, round robin recycling, the interpolation guards, bins
+ *              above 65.535 MHz and the FRAM write protection can all be checked.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include "intellitune.h"
+#include "tests/test.h"
+
+
+extern tune_solution_t tune_memory[TUNE_MEM_ENTRIES];
+extern uint8_t tune_memory_next;
+
+
+static void clear_memory(void)
+{
+    memset(tune_memory, 0, sizeof(tune_memory));
+    tune_memory_next = 0;
+}
+
+
+static tune_solution_t solution(uint16_t cap, uint16_t ind, uint8_t relays, uint8_t side)
+{
+    tune_solution_t result = { .cap_position = cap, .ind_position = ind, .relay_setting = relays,
+                               .net_side = side };
+    return result;
+}
+
+
+static uint8_t same(const tune_solution_t *a, const tune_solution_t *b)
+{
+    return (a->cap_position == b->cap_position) && (a->ind_position == b->ind_position) &&
+           (a->relay_setting == b->relay_setting) && (a->net_side == b->net_side);
+}
+
+
+static void test_store_recall(void)
+{
+    tune_solution_t stored = solution(1200, 800, 2, CAP_OUTPUT_SIDE), other = solution(300, 2000, 0, CAP_INPUT_SIDE);
+    tune_solution_t found;
+    uint8_t i, used = 0;
+
+    clear_memory();
+    CHECK(!tune_memory_recall(14200000, &found), "recall from an empty table");
+
+    tune_memory_store(14200000, &stored);
+    CHECK(tune_memory_recall(14200000, &found) && same(&found, &stored), "recall of the stored solution");
+    CHECK(tune_memory_recall(14210000, &found) && same(&found, &stored), "recall within the same 25 kHz bin");
+    CHECK(!tune_memory_recall(14230000, &found), "recall from the next bin");
+    CHECK(!tune_memory_recall(0, &found), "recall with no frequency measured");
+
+    // A second store in the same bin replaces the first rather than adding an entry
+    tune_memory_store(14205000, &other);
+    CHECK(tune_memory_recall(14200000, &found) && same(&found, &other), "store replaces the entry in its bin");
+    for(i = 0; i < TUNE_MEM_ENTRIES; i++) { used += (tune_memory[i].freq_bin != TUNE_MEM_EMPTY); }
+    CHECK(used == 1, "%u entries after two stores in one bin", used);
+
+    tune_memory_store(0, &stored);
+    CHECK(tune_memory[1].freq_bin == TUNE_MEM_EMPTY, "store with no frequency measured");
+
+    // A tune that misses the target clears its bin and leaves the others
+    tune_memory_store(7100000, &stored);
+    tune_memory_forget(14210000);
+    CHECK(!tune_memory_recall(14200000, &found), "recall from a cleared bin");
+    CHECK(tune_memory_recall(7100000, &found) && same(&found, &stored), "clear removed another bin");
+    tune_memory_forget(14200000);
+    tune_memory_forget(0);
+    CHECK(tune_memory_recall(7100000, &found), "clear of an empty bin removed an entry");
+}
+
+
+static void test_round_robin(void)
+{
+    tune_solution_t stored, found;
+    uint32_t freq_hz;
+    uint8_t i;
+
+    clear_memory();
+    for(i = 0; i <= TUNE_MEM_ENTRIES; i++)
+    {
+        freq_hz = 3500000 + (uint32_t)i * 100000;
+        stored = solution(i, 4000 - i, 0, CAP_OUTPUT_SIDE);
+        tune_memory_store(freq_hz, &stored);
+    }
+    CHECK(!tune_memory_recall(3500000, &found), "oldest entry kept after the table filled");
+    CHECK(tune_memory_recall(3600000, &found) && (found.cap_position == 1), "second entry lost");
+    CHECK(tune_memory_recall(3500000 + TUNE_MEM_ENTRIES * 100000UL, &found) &&
+          (found.cap_position == TUNE_MEM_ENTRIES), "newest entry not stored");
+    CHECK(tune_memory_next == 1, "next entry to recycle is %u", tune_memory_next);
+}
+
+
+static void test_interpolation_guards(void)
+{
+    tune_solution_t lo = solution(2000, 1500, 1, CAP_OUTPUT_SIDE), hi = solution(1800, 1400, 1, CAP_OUTPUT_SIDE);
+    tune_solution_t found;
+
+    clear_memory();
+    tune_memory_store(7000000, &lo);
+    CHECK(!tune_memory_interpolate(7100000, &found), "prediction from one neighbour");
+    tune_memory_store(7200000, &hi);
+    CHECK(tune_memory_interpolate(7100000, &found), "no prediction between two neighbours");
+    CHECK((found.ind_position <= 1500) && (found.ind_position >= 1400) && (found.net_side == CAP_OUTPUT_SIDE),
+          "prediction outside its neighbours, inductor %u", found.ind_position);
+    CHECK(!tune_memory_interpolate(6900000, &found), "prediction below the lowest entry");
+    CHECK(!tune_memory_interpolate(7300000, &found), "prediction above the highest entry");
+
+    hi.net_side = CAP_INPUT_SIDE;
+    tune_memory_store(7200000, &hi);
+    CHECK(!tune_memory_interpolate(7100000, &found), "prediction across a change of network side");
+
+    clear_memory();
+    tune_memory_store(7000000, &lo);
+    tune_memory_store(7000000 + (7000000 >> TUNE_MEM_INTERP_SPAN_SHIFT) + 50000, &lo);
+    CHECK(!tune_memory_interpolate(7150000, &found), "prediction across more than the span");
+}
+
+
+static void test_wide_frequencies(void)
+{
+    tune_solution_t low = solution(100, 200, 0, CAP_OUTPUT_SIDE), high = solution(300, 400, 0, CAP_OUTPUT_SIDE);
+    tune_solution_t found;
+
+    // kHz values above 16 bits must keep their own bins rather than wrap onto low ones
+    clear_memory();
+    tune_memory_store(4500000, &low);
+    tune_memory_store(70036000, &high); // 70.036 MHz, 4.500 MHz + 65.536 MHz
+    CHECK(tune_memory_recall(4500000, &found) && same(&found, &low), "4.5 MHz entry overwritten from 70 MHz");
+    CHECK(tune_memory_recall(70036000, &found) && same(&found, &high), "70 MHz entry not recalled");
+
+    // Beyond the last 16 bit bin every frequency shares it
+    tune_memory_store(4000000000UL, &high);
+    CHECK(tune_memory_recall(3900000000UL, &found) && same(&found, &high), "last bin not shared");
+    CHECK(tune_memory_recall(4500000, &found) && same(&found, &low), "4.5 MHz entry lost to the last bin");
+}
+
+
+static void test_write_protection(void)
+{
+    tune_solution_t stored = solution(1, 2, 0, CAP_OUTPUT_SIDE);
+
+    clear_memory();
+    SYSCFG0 = FRWPPW | PFWP;
+    tune_memory_store(21200000, &stored);
+    CHECK(SYSCFG0 & PFWP, "program FRAM left writable after a store");
+    SYSCFG0 = FRWPPW;
+    tune_memory_store(21300000, &stored);
+    CHECK(!(SYSCFG0 & PFWP), "protection set by a store that found it clear");
+    SYSCFG0 = FRWPPW | PFWP;
+    tune_memory_forget(21300000);
+    CHECK(SYSCFG0 & PFWP, "program FRAM left writable after a clear");
+}
+
+
+int main(void)
+{
+    test_store_recall();
+    test_round_robin();
+    test_interpolation_guards();
+    test_wide_frequencies();
+    test_write_protection();
+    return TEST_RESULT("test_tune_memory");
+}
@@ -0,0 +1,161 @@
+/*
+ * File: touchstone.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: Touchstone 1-port (.s1p) reader for the host simulator. A sweep
+ *              measured with an antenna analyzer or VNA at the end of the feedline
+ *              becomes a SIM_LOAD_TABLE load, so the tune benchmark can run against
+ *              real antennas as well as the analytic models.
+ *
+ *              The option line "# <unit> <parameter> <format> R <ohms>" may give
+ *              the frequency unit (Hz, kHz, MHz, GHz), the parameter (S, Z or Y,
+ *              Z and Y normalized to R) and the format (MA, DB or RI). Missing
+ *              fields take the Touchstone defaults, GHz S MA R 50. Comments start
+ *              with '!'. Points must be in ascending frequency.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "sim.h"
+
+
+// Function Prototypes
+static int parse_options(char *line, double *unit, char *parameter, char *format, double *z0);
+static double complex to_impedance(double a, double b, char parameter, char format, double z0);
+
+
+#define TOUCHSTONE_POINTS_MAX       65535 // table_points is 16 bits
+
+
+// Read the fields of an option line. Returns 0, or -1 on an unknown field.
+static int parse_options(char *line, double *unit, char *parameter, char *format, double *z0)
+{
+    char *field = strtok(line + 1, " \t\r\n");
+
+    while(field != NULL)
+    {
+        if(strcasecmp(field, "HZ") == 0) { *unit = 1.0; }
+        else if(strcasecmp(field, "KHZ") == 0) { *unit = 1e3; }
+        else if(strcasecmp(field, "MHZ") == 0) { *unit = 1e6; }
+        else if(strcasecmp(field, "GHZ") == 0) { *unit = 1e9; }
+        else if((strcasecmp(field, "S") == 0) || (strcasecmp(field, "Z") == 0) ||
+                (strcasecmp(field, "Y") == 0)) { *parameter = field[0] & ~0x20; }
+        else if((strcasecmp(field, "MA") == 0) || (strcasecmp(field, "DB") == 0) ||
+                (strcasecmp(field, "RI") == 0)) { *format = field[0] & ~0x20; }
+        else if(strcasecmp(field, "R") == 0)
+        {
+            field = strtok(NULL, " \t\r\n");
+            if((field == NULL) || ((*z0 = atof(field)) <= 0.0)) { return -1; }
+        }
+        else { return -1; }
+        field = strtok(NULL, " \t\r\n");
+    }
+    return 0;
+}
+
+
+// Load impedance of one data point.
+static double complex to_impedance(double a, double b, char parameter, char format, double z0)
+{
+    double complex value;
+
+    if(format == 'R') { value = a + I * b; }
+    else
+    {
+        if(format == 'D') { a = pow(10.0, a / 20.0); }
+        value = a * cexp(I * b * M_PI / 180.0);
+    }
+
+    if(parameter == 'Z') { return value * z0; }
+    if(parameter == 'Y') { return z0 / value; }
+    return z0 * (1.0 + value) / (1.0 - value);
+}
+
+
+// Read a .s1p file into a SIM_LOAD_TABLE load named after the file. The points are
+// allocated for the life of the process. Returns the number of points, or -1 if the
+// file cannot be opened or is malformed.
+int sim_load_touchstone(const char *path, sim_load_t *load)
+{
+    char line[256], parameter = 'S', format = 'M', *comment;
+    const char *name;
+    double unit = 1e9, z0 = 50.0, f, a, b, last = -1.0;
+    double *hz = NULL;
+    double complex *z = NULL;
+    size_t points = 0, size = 0;
+    int line_number = 0, options = 0;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL) { return -1; }
+    while(fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        if((comment = strchr(line, '!')) != NULL) { *comment = '\0'; }
+        if(strspn(line, " \t\r\n") == strlen(line)) { continue; }
+        if(line[strspn(line, " \t")] == '#')
+        {
+            if(options++ || parse_options(strchr(line, '#'), &unit, &parameter, &format, &z0))
+            {
+                fprintf(stderr, "%s:%d: bad option line\n", path, line_number);
+                goto fail;
+            }
+            continue;
+        }
+        if((sscanf(line, "%lf %lf %lf", &f, &a, &b) != 3) || (f * unit <= last))
+        {
+            fprintf(stderr, "%s:%d: expected frequency, then two values, in ascending frequency\n",
+                    path, line_number);
+            goto fail;
+        }
+        if(points == TOUCHSTONE_POINTS_MAX)
+        {
+            fprintf(stderr, "%s:%d: more than %d points\n", path, line_number, TOUCHSTONE_POINTS_MAX);
+            goto fail;
+        }
+        if(points == size)
+        {
+            double *grown_hz = realloc(hz, 2 * (size + 32) * sizeof(*hz));
+            double complex *grown_z;
+
+            if(grown_hz == NULL) { goto fail; }
+            hz = grown_hz;
+            grown_z = realloc(z, 2 * (size + 32) * sizeof(*z));
+            if(grown_z == NULL) { goto fail; }
+            z = grown_z;
+            size = 2 * (size + 32);
+        }
+        last = f * unit;
+        hz[points] = last;
+        z[points] = to_impedance(a, b, parameter, format, z0);
+        points++;
+    }
+    fclose(file);
+    if(points == 0)
+    {
+        fprintf(stderr, "%s: no data points\n", path);
+        free(hz);
+        free(z);
+        return -1;
+    }
+
+    memset(load, 0, sizeof(*load));
+    name = strrchr(path, '/');
+    snprintf(load->name, sizeof(load->name), "%s", name ? name + 1 : path);
+    if((comment = strrchr(load->name, '.')) != NULL) { *comment = '\0'; }
+    load->model = SIM_LOAD_TABLE;
+    load->table_hz = hz;
+    load->table_z = z;
+    load->table_points = (uint16_t)points;
+    return (int)points;
+
+fail:
+    fclose(file);
+    free(hz);
+    free(z);
+    return -1;
+}
@@ -0,0 +1,215 @@
+/*
+ * File: impedance_solver.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: This file will contain the functions to recover the complex load
+ *              impedance from the two reflection coefficient magnitudes measured with
+ *              the known 25 ohm impedance switched out and in (P3.6), and to compute
+ *              the L-network values that match the load to the 50 ohm source.
+ *
+ *              For a load r + jx normalized to the source, a reflection magnitude |G|
+ *              places the load on the circle
+ *                  r^2 + x^2 + 1 = 2 * r * k,  with k = (1 + |G|^2) / (1 - |G|^2)
+ *              Switching in the known series impedance a shifts r by a and gives a
+ *              second circle. Subtracting the two removes x and leaves r directly,
+ *              after which x follows from either circle. Magnitudes carry no phase, so
+ *              the sign of x is unknown and a network is computed for both signs.
+ *
+ *              A tune that skips homing measures through the network left by the
+ *              last one, so r + jx is the input of that network rather than the load.
+ *              For each sign of x the network is then removed again, element by
+ *              element, before matching.
+ *
+ ******************************************************************************/
+
+#include "intellitune.h"
+
+
+// Function Prototypes
+uint8_t solve_load_impedance(_iq16 gamma_out, _iq16 gamma_in, _iq16 angular_frequency,
+                             const tune_solution_t *network, load_solution_t *load);
+void network_to_positions(const load_solution_t *load, uint8_t candidate,
+                          tune_solution_t *positions);
+
+
+// Replace the normalized impedance re + jim by its reciprocal. Returns 0 if either
+// value is out of the range Q16 can invert.
+static uint8_t invert_impedance(_iq16 *re, _iq16 *im)
+{
+    _iq16 magnitude;
+
+    if((*re > _IQ16(INVERT_MAX)) || (*re < -_IQ16(INVERT_MAX)) ||
+       (*im > _IQ16(INVERT_MAX)) || (*im < -_IQ16(INVERT_MAX))) { return 0; }
+    magnitude = _IQ16mpy(*re, *re) + _IQ16mpy(*im, *im);
+    if(magnitude < _IQ16(1.0 / (INVERT_MAX * INVERT_MAX))) { return 0; }
+    *re = _IQ16div(*re, magnitude);
+    *im = _IQ16div(-*im, magnitude);
+    return 1;
+}
+
+
+// Normalized series reactance and shunt susceptance of the network set by the
+// given positions, relays and side at angular_frequency (Mrad/s).
+static void positions_to_network(const tune_solution_t *network, _iq16 angular_frequency,
+                                 _iq16 *x_series, _iq16 *b_shunt)
+{
+    _iq16 capacitance, inductance;
+
+    // Inverse of network_to_positions(), pF and uH
+    capacitance = _IQ16div(_IQ16(500), _IQ16(C_UPPER_LIMIT) - _IQ16(C_LOWER_LIMIT)) * network->cap_position;
+    capacitance += _IQ16(470) * network->relay_setting;
+    inductance = _IQ16div(_IQ16(24), _IQ16(L_UPPER_LIMIT) - _IQ16(L_LOWER_LIMIT)) * network->ind_position;
+
+    *x_series = _IQ16mpy(angular_frequency, inductance) / (int32_t)SOURCE_IMPEDANCE;
+    *b_shunt = _IQ16mpy(_IQ16mpy(angular_frequency, _IQ16div(capacitance, _IQ16(1000))),
+                        _IQ16(SOURCE_IMPEDANCE / 1000.0));
+}
+
+
+// Take the network back off the normalized impedance r + jx measured at its input,
+// leaving the load it was measured through. Returns 0 if the load is out of range.
+static uint8_t remove_network(_iq16 *r, _iq16 *x, _iq16 x_series, _iq16 b_shunt, uint8_t side)
+{
+    if(side == CAP_INPUT_SIDE)
+    {
+        if(!invert_impedance(r, x)) { return 0; }
+        *x -= b_shunt;
+        if(!invert_impedance(r, x)) { return 0; }
+        *x -= x_series;
+    } else {
+        *x -= x_series;
+        if(!invert_impedance(r, x)) { return 0; }
+        *x -= b_shunt;
+        if(!invert_impedance(r, x)) { return 0; }
+    }
+    return (*r > 0);
+}
+
+
+// Compute the normalized series reactance and shunt susceptance that match the
+// normalized load r + jx with the capacitor on the given side of the inductor.
+// Returns 1 if the network can be built from a series inductor and shunt capacitor.
+static uint8_t match_network(_iq16 r, _iq16 x, uint8_t side, _iq16 *x_series, _iq16 *b_shunt)
+{
+    static const _iq16 iq_one = _IQ16(1.0);
+    _iq16 magnitude, g, b, b_match, x_match;
+
+    if(side == CAP_OUTPUT_SIDE)
+    {
+        // Shunt capacitor across the load brings its conductance onto the 1 + jb circle
+        magnitude = _IQ16mpy(r, r) + _IQ16mpy(x, x);
+        g = _IQ16div(r, magnitude);
+        b = _IQ16div(-x, magnitude);
+        if(g > iq_one) { return 0; }
+        b_match = _IQ16sqrt(g - _IQ16mpy(g, g));
+        *x_series = _IQ16div(b_match, g);
+        *b_shunt = b_match - b;
+    } else {
+        // Series inductor brings the load onto the 1 + jb admittance circle
+        if(r > iq_one) { return 0; }
+        x_match = _IQ16sqrt(r - _IQ16mpy(r, r));
+        *x_series = x_match - x;
+        *b_shunt = _IQ16div(x_match, r);
+    }
+    return (*x_series >= 0) && (*b_shunt >= 0);
+}
+
+
+// Solve for the load impedance from |G| measured with the known impedance switched
+// out (gamma_out) and in (gamma_in), and compute the matching network for both signs
+// of the load reactance at angular_frequency (Mrad/s). network holds the positions
+// the measurements were taken at, NULL when the motors were homed. Returns the
+// number of candidate networks that can be built within the component ranges.
+uint8_t solve_load_impedance(_iq16 gamma_out, _iq16 gamma_in, _iq16 angular_frequency,
+                             const tune_solution_t *network, load_solution_t *load)
+{
+    static const _iq16 iq_one = _IQ16(1.0);
+    static const _iq16 known = _IQ16(KNOWN_IMPEDANCE / SOURCE_IMPEDANCE);
+    _iq16 g, k_out, k_in, numerator, denominator, r, x, r_load, x_load, x_series, b_shunt;
+    _iq16 x_network = 0, b_network = 0;
+    uint8_t i, side, valid = 0;
+
+    if((gamma_out >= iq_one) || (gamma_in >= iq_one)) { return 0; }
+
+    g = _IQ16mpy(gamma_out, gamma_out);
+    k_out = _IQ16div(iq_one + g, iq_one - g);
+    g = _IQ16mpy(gamma_in, gamma_in);
+    k_in = _IQ16div(iq_one + g, iq_one - g);
+
+    numerator = _IQ16mpy(2 * known, k_in) - _IQ16mpy(known, known);
+    denominator = (2 * known) + (2 * (k_out - k_in));
+    if((numerator <= 0) || (denominator <= 0)) { return 0; }
+    r = _IQ16div(numerator, denominator);
+
+    x = _IQ16mpy(2 * r, k_out) - _IQ16mpy(r, r) - iq_one;
+    if(x < 0) { x = 0; } // Measurement noise on a resistive load
+    x = _IQ16sqrt(x);
+
+    load->resistance = _IQ16mpy(r, _IQ16(SOURCE_IMPEDANCE));
+    load->reactance = _IQ16mpy(x, _IQ16(SOURCE_IMPEDANCE));
+    if(network != NULL) { positions_to_network(network, angular_frequency, &x_network, &b_network); }
+
+    for(i = 0; i < 2; i++)
+    {
+        load->valid[i] = 0;
+        if((i == 1) && (x == 0)) { break; } // Both signs give the same network
+
+        r_load = r;
+        x_load = (i == 0) ? x : -x;
+        if((network != NULL) && !remove_network(&r_load, &x_load, x_network, b_network, network->net_side)) {
+            continue;
+        }
+        if((network != NULL) && (i == 0)) {
+            // Report the load behind the network rather than the network input
+            load->resistance = _IQ16mpy(r_load, _IQ16(SOURCE_IMPEDANCE));
+            load->reactance = _IQ16mpy((x_load < 0) ? -x_load : x_load, _IQ16(SOURCE_IMPEDANCE));
+        }
+        side = (r_load > iq_one) ? CAP_OUTPUT_SIDE : CAP_INPUT_SIDE;
+        if(!match_network(r_load, x_load, side, &x_series, &b_shunt))
+        {
+            side = (side == CAP_OUTPUT_SIDE) ? CAP_INPUT_SIDE : CAP_OUTPUT_SIDE;
+            if(!match_network(r_load, x_load, side, &x_series, &b_shunt)) { continue; }
+        }
+
+        // L = X / w and C = B / w, converted from normalized values to uH and pF. The
+        // range is checked before scaling, which would overflow Q16 and could wrap
+        // an unbuildable network back into range.
+        x_series = _IQ16div(x_series, angular_frequency);
+        b_shunt = _IQ16div(b_shunt, angular_frequency);
+        if((x_series > _IQ16(IND_MAX / SOURCE_IMPEDANCE)) ||
+           (b_shunt > _IQ16(CAP_MAX * SOURCE_IMPEDANCE / 1000000.0))) { continue; }
+        load->inductance[i] = _IQ16mpy(x_series, _IQ16(SOURCE_IMPEDANCE));
+        load->capacitance[i] = _IQ16mpy(b_shunt, _IQ16(1000000.0 / SOURCE_IMPEDANCE));
+        load->net_side[i] = side;
+        load->valid[i] = 1;
+        valid++;
+    }
+    return valid;
+}
+
+
+// Convert a candidate network to motor positions, capacitor relay setting and
+// network side.
+void network_to_positions(const load_solution_t *load, uint8_t candidate,
+                          tune_solution_t *positions)
+{
+    _iq16 varicap_value, temp, iq_position;
+
+    temp = load->capacitance[candidate] - _IQ16(30.0);
+    if(temp < 0) { temp = 0; } // Below the varicap minimum, use the smallest setting
+    temp = _IQ16div(temp, _IQ16(470));
+    positions->relay_setting = (uint8_t)_IQ16int(temp);
+    varicap_value = _IQ16frac(temp);
+    varicap_value = _IQ16mpy(varicap_value, _IQ16(470));
+    varicap_value = varicap_value + _IQ16(30.0);
+    iq_position = _IQ16div((_IQ16(C_UPPER_LIMIT) - _IQ16(C_LOWER_LIMIT)), _IQ16(500));
+    iq_position = _IQ16rmpy(iq_position, varicap_value);
+    positions->cap_position = (uint16_t)_IQ16int(iq_position);
+
+    iq_position = _IQ16div((_IQ16(L_UPPER_LIMIT) - _IQ16(L_LOWER_LIMIT)), _IQ16(24));
+    iq_position = _IQ16rmpy(iq_position, load->inductance[candidate]);
+    positions->ind_position = (uint16_t)_IQ16int(iq_position);
+
+    positions->net_side = load->net_side[candidate];
+}
@@ -37,21 +37,42 @@
 
 // Function Prototypes
 void tune(void);
+void tune_abort(void);
+void home_network(void);
+void complete_tune(_iq16 final_gamma);
+void start_pattern_search(void);
+uint8_t pattern_search(void);
 void clock_configure(void);
 void init_gpio(void);
 
-char cap2_val[8] = {'\0'};
-char ind2_val[6] = {'\0'};
-char swr_val[5] = {'\0'};
-char load_imp[7] = {'\0'};
 uint8_t tune_task = 0;
 uint8_t relay_setting = 0;
+uint16_t homing_saved_ms = 0; // Homing time skipped by the most recent tune
+uint16_t fine_tune_probes = 0; // SWR probes taken by the most recent fine tune
+uint16_t fine_tune_ms = 0; // Duration of the most recent fine tune
+uint16_t tune_count = 0; // Tunes completed since power up
+tune_report_t tune_report; // Benchmark figures of the most recent tune
+tune_snapshot_t tune_snapshot = {0}; // Numeric results for the display, formatted by the UI
+static uint32_t tune_start, cap_steps_start, ind_steps_start;
+static _iq16 target_gamma; // Reflection coefficient of the target SWR setting
+static uint8_t task_status = 0; // Step within the current tune task
+static uint32_t tune_frequency; // Frequency the running tune was started for, Hz
+static uint8_t tune_restarts = 0; // Restarts of the running tune request
+static uint32_t tune_rf_lost; // Time the running tune lost its carrier
+static uint8_t tune_waiting_rf = 0; // Running tune is held for the carrier
+static uint8_t tune_homed = 0; // Running tune has homed the network
+
+// Pattern search state
+static uint32_t search_start;
+static uint16_t center_cap, center_ind, probe_cap, probe_ind, search_step;
+static _iq16 best_gamma;
+static uint8_t search_state, search_dir;
 
 
 // This global will be used to notify user that a new adc value has been sampled
 uint8_t adc_flg = 0;
 // Broken down as follows:    BIT0    |    BIT1   |      BIT2       |  BIT3  |  BIT4  |  BIT5  |    BIT6    |  BIT7
-//                         IMP_SWITCH   SWR_SENSE   SWR_KNOWN_SENSE   unused   CAP POT  IND POT  ADC Status   unused
+//                         IMP_SWITCH   SWR_SENSE   SWR_KNOWN_SENSE  UNDER_RANGE CAP POT IND POT ADC Status  unused
 //                         (w/o 25ohm res)   (with 25ohm res)
 
 // Main Program function
@@ -109,25 +130,100 @@ int main(void) {
 // TODO: Implement tuning algorithm
 void tune(void)
 {
-    static _iq16 Q_factor, temp, Z_load, ind_react, cap_react, estimated_inductance, estimated_capacitance,
-                    angular_frequency, gamma_1, gamma_2, vswr, numerator, denominator, div_res;
-    static const _iq16 Z_source = _IQ16(50.0);
+    static _iq16 angular_frequency, gamma_1, gamma_2, vswr;
+    static _iq16 candidate_gamma[2];
     static const _iq16 iq_one = _IQ16(1.0);
-    static uint8_t task_status = 0;
+    static load_solution_t load;
+    static tune_solution_t solution;
+    static uint8_t recall = NO_RECALL;
+    static uint8_t candidate, candidates_checked;
+    static uint8_t recall_refined; // The recalled solution has had its line search
+
+    // Without a carrier there is nothing to measure. Hold the tune where it is
+    // and give it up if the carrier does not return.
+    if(!(task_flag & RF_PRESENT)) {
+        if(!tune_waiting_rf) {
+            tune_waiting_rf = 1;
+            tune_rf_lost = system_ticks();
+        } else if((system_ticks() - tune_rf_lost) > TUNE_NO_RF_TICKS) {
+            tune_abort();
+            tune_restarts = 0;
+            tune_waiting_rf = 0;
+            button_press &= ~TUNE & ~MODE_LOCK;
+        }
+        return;
+    }
+    tune_waiting_rf = 0;
+
+    // A change of band makes the tune so far useless, start over for the new one
+    if((tune_task != INITIALIZE_TUNE_COMPONENTS) && frequency_moved(tune_frequency)) {
+        tune_abort();
+        return;
+    }
 
     switch(tune_task)
     {
         case INITIALIZE_TUNE_COMPONENTS:
         {
-            step_cap_motor(RETURN_START_MODE);
-            step_ind_motor(RETURN_START_MODE);
+            if(task_status == 0) {
+                if(tune_restarts == 0) {
+                    tune_start = system_ticks();
+                    __bic_SR_register(GIE); // The stepper interrupt counts the steps
+                    cap_steps_start = cap_motor_steps;
+                    ind_steps_start = ind_motor_steps;
+                    __bis_SR_register(GIE);
+                }
+                tune_homed = 0;
+                tune_frequency = frequency;
+                fine_tune_probes = 0;
+                fine_tune_ms = 0;
+                recall_refined = 0;
+                vswr = swr_setting(target_swr);
+                target_gamma = _IQ16div(vswr - iq_one, vswr + iq_one);
+                if(tune_memory_recall(frequency, &solution)) {
+                    recall = STORED_RECALL; // Known frequency, drive straight to the stored solution
+                } else if(tune_memory_interpolate(frequency, &solution)) {
+                    recall = INTERPOLATED_RECALL; // Between known points, seed the fine tune
+                } else {
+                    recall = NO_RECALL;
+                }
+                if(recall != NO_RECALL) {
+                    homing_saved_ms = homing_time_ms();
+                    tune_task = ADJUST_TO_ESTIMATES;
+                    return;
+                }
+                if(positions_plausible()) {
+                    // Measure from the current position, no need to return to start
+                    homing_saved_ms = homing_time_ms();
+                    tune_task++;
+                    return;
+                }
+                home_network();
+                task_status++;
+            } else if(!(task_flag & MOTOR_ACTIVE)) {
+                tune_task++;
+                task_status = 0;
+            }
             break;
         }
 
         case CALCULATE_SWR:
         {
+            if(task_status == 0) {
+                discard_swr_pairs(); // Discard readings taken while the motors moved
+                task_status++;
+                return;
+            }
             gamma_1 = calculate_ref_coeff(KNOWN_SWITCHED_OUT);//_IQ16(0.818182);
             if(gamma_1 == 0) { return; }
+            task_status = 0;
+            if(gamma_1 <= target_gamma) { tune_task = REPORT_TUNE; } // Already matched
+            else if(!tune_homed && (gamma_1 > _IQ16(INCREMENTAL_GAMMA_MAX))) {
+                // Too far off to see the load through the network, home and measure again
+                home_network();
+                tune_task = INITIALIZE_TUNE_COMPONENTS;
+                task_status = 1;
+            }
             else { tune_task++; }
             break;
         }
@@ -137,7 +233,8 @@ void tune(void)
             if(task_status == 0){
                 P3OUT |= BIT6;
                 adc_flg |= IMP_SWITCH;
-                adc_channel_select = FWD_PIN;
+                // A channel sequence picks up the switch when it next starts
+                if(adc_mode == ADC_MODE_SINGLE) { adc_channel_select = FWD_PIN; }
                 task_status++;
             }
             gamma_2 = calculate_ref_coeff(KNOWN_SWITCHED_IN);//_IQ16(0.826);
@@ -148,133 +245,338 @@ void tune(void)
 
         case ESTIMATE_TUNE_VALUES:
         {
-
-            char cap_val[7] = {'\0'};
-            char ind_val[7] = {'\0'};
-            char q_val[6] = {'\0'};
-            memset(&cap2_val[0], 0, sizeof(cap2_val));
-            memset(&ind2_val[0], 0, sizeof(ind2_val));
-            memset(&swr_val[0], 0, sizeof(swr_val));
-            memset(&load_imp[0], 0, sizeof(load_imp));
-            uint8_t error = 0;
-
-            _iq16 iq_freq = _IQ16div(_IQ16(frequency), _IQ16(1000));
-            angular_frequency = _IQ16mpy(_IQ16(2*PI), iq_freq); // in Mega rad/s
-            numerator = iq_one + gamma_1;
-            denominator = iq_one - gamma_1;
-            vswr = _IQ16div(numerator, denominator);
-            error += _IQ16toa(swr_val,"%2.1f", vswr);
-            div_res = vswr;
-            if(gamma_2 > gamma_1)
-            {
-                Z_load = _IQ16mpy(Z_source, div_res);
-                error += _IQ16toa(load_imp, "%4.4f", Z_load);
-                temp = _IQ16div(Z_load, Z_source);
-                temp = temp - iq_one;
-                Q_factor = _IQ16sqrt(temp);
-                error += _IQ16toa(q_val, "%2.2f", Q_factor);
-                ind_react = _IQ16mpy(Q_factor, Z_source);
-                error += _IQ16toa(ind_val, "%4.2f", ind_react);
-                cap_react = _IQ16div(Z_load, Q_factor);
-                error += _IQ16toa(cap_val, "%4.2f", cap_react);
-                P3OUT &= ~BIT4; // Capacitors switched to output side.
-            } else if(gamma_2 < gamma_1)
-            {
-                div_res = _IQ16div(iq_one, div_res);
-                Z_load = _IQ16mpy(Z_source, div_res);
-                error += _IQ16toa(load_imp, "%3.2f", Z_load);
-                temp = _IQ16div(Z_source, Z_load);
-                temp = temp - iq_one;
-                Q_factor = _IQ16sqrt(temp);
-                error += _IQ16toa(q_val, "%2.2f", Q_factor);
-                ind_react = _IQ16mpy(Q_factor, Z_load);
-                error += _IQ16toa(ind_val, "%4.2f", ind_react);
-                cap_react = _IQ16div(Z_source, Q_factor);
-                error += _IQ16toa(cap_val, "%4.2f", cap_react);
-                P3OUT |= BIT4; // Capacitors switched to input side.
-            } else { return; }
-
-
-            estimated_capacitance = _IQ16div(iq_one, cap_react);
-            estimated_capacitance = _IQ16mpy(estimated_capacitance, _IQ16(10000));
-            estimated_capacitance = _IQ16div(estimated_capacitance, angular_frequency);
-            estimated_capacitance = _IQ16mpy(estimated_capacitance, _IQ16(100)); // in pF
-            error += _IQ16toa(cap2_val, "%4.2f", estimated_capacitance);
-
-            estimated_inductance = _IQ16div(ind_react, angular_frequency); // in uH
-            error += _IQ16toa(ind2_val, "%2.2f", estimated_inductance);
-
-            if((estimated_capacitance < _IQ16(0.0)) || (estimated_inductance < _IQ16(0.0))) {
-                tune_task = CALCULATE_SWR;
-            } else if((estimated_capacitance > _IQ16(CAP_MAX)) || (estimated_inductance > _IQ16(IND_MAX))) {
-                            tune_task = CALCULATE_SWR;
-            } else if((vswr < _IQ16(0.0)) || (Z_load < _IQ16(0.0))) {
-                tune_task = CALCULATE_SWR;
+            angular_frequency = FREQ_HZ_TO_OMEGA(frequency); // in Mega rad/s
+            vswr = vswr_from_gamma(gamma_1);
+
+            // Recover R and |X| of the load and the network for either sign of X. The
+            // readings were taken through the network as it stands, nearly transparent
+            // only if the motors were homed.
+            solution.cap_position = cap_sample;
+            solution.ind_position = ind_sample;
+            solution.relay_setting = relay_setting;
+            solution.net_side = net_side;
+            if(solve_load_impedance(gamma_1, gamma_2, angular_frequency, &solution, &load) == 0) {
+                if(!tune_homed) {
+                    home_network(); // As for a large mismatch in CALCULATE_SWR
+                    tune_task = INITIALIZE_TUNE_COMPONENTS;
+                    task_status = 1;
+                } else {
+                    tune_task = FINE_TUNE; // No network in range, search for the best there is
+                }
+                break;
             }
-
-            if(error == 0) { tune_task++; }
+            candidate = load.valid[0] ? 0 : 1;
+            candidates_checked = 0;
+            network_to_positions(&load, candidate, &solution);
+
+            // Publish the estimate, the display formats it on its next refresh
+            tune_snapshot.vswr = vswr;
+            tune_snapshot.resistance = load.resistance;
+            tune_snapshot.capacitance = load.capacitance[candidate];
+            tune_snapshot.inductance = load.inductance[candidate];
+            tune_snapshot.seq++;
+
+            tune_task++;
             break;
         }
 
         case ADJUST_TO_ESTIMATES:
         {
             if(task_status == 0) {
-                _iq16 varicap_value, temp, iq_position;
-                uint16_t cap_position, ind_position;
-                temp = estimated_capacitance - _IQ16(30.0);
-                temp = _IQ16div(temp, _IQ16(470));
-                relay_setting = (uint8_t)_IQ16int(temp);
-                varicap_value = _IQ16frac(temp);
-                varicap_value = _IQ16mpy(varicap_value, _IQ16(470));
-                varicap_value = varicap_value + _IQ16(30.0);
-                iq_position = _IQ16div((_IQ16(C_UPPER_LIMIT) - _IQ16(C_LOWER_LIMIT)), _IQ16(500));
-                iq_position = _IQ16rmpy(iq_position, varicap_value);
-                cap_position = (uint16_t)_IQ16int(iq_position);
-
-                iq_position = _IQ16div((_IQ16(L_UPPER_LIMIT) - _IQ16(L_LOWER_LIMIT)), _IQ16(24));
-                iq_position = _IQ16rmpy(iq_position, estimated_inductance);
-                ind_position = (uint16_t)_IQ16int(iq_position);
-
-                step_cap_motor((cap_position << 4) | CMD_POS_MODE);
-                step_ind_motor((ind_position << 4) | CMD_POS_MODE);
+                step_cap_motor((solution.cap_position << 4) | CMD_POS_MODE);
+                step_ind_motor((solution.ind_position << 4) | CMD_POS_MODE);
 
+                relay_setting = solution.relay_setting;
                 switch_cap_relay(relay_setting);
+                switch_net_config(solution.net_side);
 
                 task_status++;
             } else if(task_status == 1) {
                 if(!(task_flag & MOTOR_ACTIVE)) {
-                    tune_task++;
+                    if(recall == STORED_RECALL) { tune_task = VERIFY_RECALL; }
+                    else if((recall == NO_RECALL) && (candidates_checked < 2)) { tune_task = CHECK_ESTIMATE; }
+                    else { tune_task = FINE_TUNE; }
                     task_status = 0;
                 }
             }
             break;
         }
 
+        case CHECK_ESTIMATE:
+        {
+            // The sign of the load reactance is unknown, so measure the network for
+            // the current candidate and try the other one if it misses the target.
+            if(task_status == 0) {
+                discard_swr_pairs(); // Discard readings taken while the motors moved
+                task_status++;
+                return;
+            }
+            gamma_1 = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
+            if(gamma_1 == 0) { return; }
+            task_status = 0;
+            candidate_gamma[candidate] = gamma_1;
+            candidates_checked++;
+
+            if(gamma_1 <= target_gamma) {
+                tune_task = REPORT_TUNE;
+            } else if((candidates_checked == 1) && load.valid[candidate ^ 1]) {
+                candidate ^= 1;
+                network_to_positions(&load, candidate, &solution);
+                tune_task = ADJUST_TO_ESTIMATES;
+            } else if((candidates_checked == 2) && (candidate_gamma[candidate ^ 1] < gamma_1)) {
+                // First candidate was closer, return to it before the fine tune
+                candidate ^= 1;
+                network_to_positions(&load, candidate, &solution);
+                tune_task = ADJUST_TO_ESTIMATES;
+            } else {
+                tune_task = FINE_TUNE;
+            }
+            break;
+        }
+
         case FINE_TUNE:
         {
             if(task_status == 0) {
-                step_cap_motor(FINE_TUNE_MODE);
-                task_status = 3;
-            } else if(task_status == 1) {
-                step_ind_motor(FINE_TUNE_MODE);
-                task_status = 4;
-            } else if(task_status == 3) {
-                if(!(task_flag & MOTOR_ACTIVE)) { task_status = 1; }
+                start_pattern_search();
+                task_status++;
+            } else if(pattern_search()) {
+                task_status = 0;
+                tune_task = REPORT_TUNE;
+            }
+            break;
+        }
+
+        case VERIFY_RECALL:
+        {
+            if(task_status == 0) {
+                discard_swr_pairs(); // Discard readings taken while the motors moved
+                task_status++;
                 return;
-            } else if(task_status == 4) {
+            }
+            gamma_1 = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
+            if(gamma_1 == 0) { return; }
+            vswr = vswr_from_gamma(gamma_1);
+            task_status = 0;
+            if(gamma_1 <= target_gamma) { tune_task = REPORT_TUNE; }
+            else if(!recall_refined) { tune_task = REFINE_RECALL; } // Stored solution drifted, refine it
+            else {
+                // Stored for a different load, tune as if there were no memory
+                recall = NO_RECALL;
+                tune_task = CALCULATE_SWR;
+            }
+            break;
+        }
+
+        case REFINE_RECALL:
+        {
+            // A drifted solution is close to the minimum, so a short line search
+            // on each component is enough to recover it.
+            if(task_status == 0) {
+                step_cap_motor((RECALL_REFINE_WINDOW << 4) | LINE_SEARCH_MODE);
+                task_status = 1;
+            } else if(task_status == 1) {
                 if(!(task_flag & MOTOR_ACTIVE)) { task_status = 2; }
-                return;
             } else if(task_status == 2) {
-                task_status = 0;
-                tune_task = INITIALIZE_TUNE_COMPONENTS;
-                button_press &= ~TUNE & ~MODE_LOCK;
+                step_ind_motor((RECALL_REFINE_WINDOW << 4) | LINE_SEARCH_MODE);
+                task_status = 3;
+            } else if(task_status == 3) {
+                if(!(task_flag & MOTOR_ACTIVE)) {
+                    task_status = 0;
+                    recall_refined = 1;
+                    tune_task = VERIFY_RECALL; // Measure the refined solution against the target
+                }
+            }
+            break;
+        }
+
+        case REPORT_TUNE:
+        {
+            // Measure the converged position once so every path reports alike
+            if(task_status == 0) {
+                discard_swr_pairs();
+                task_status++;
+                return;
             }
+            gamma_1 = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
+            if(gamma_1 == 0) { return; }
+            task_status = 0;
+            tune_report.recall = recall;
+            complete_tune(gamma_1);
             break;
         }
     }
 }
 
 
+// Abandon the running tune after a change of frequency. The motors stop where
+// they are and the tune starts again from INITIALIZE_TUNE_COMPONENTS, which
+// looks up tune memory for the new frequency. The tune request stays set.
+void tune_abort(void)
+{
+    stop_motors();
+    P3OUT &= ~BIT6; // Switch out the known impedance
+    adc_flg &= ~IMP_SWITCH;
+    discard_swr_pairs();
+    tune_task = INITIALIZE_TUNE_COMPONENTS;
+    task_status = 0;
+    if(tune_restarts < 0xFF) { tune_restarts++; }
+}
+
+
+// Return both motors to their lower limits and switch out the capacitor relays, so
+// the next readings see the load through a nearly transparent network.
+void home_network(void)
+{
+    relay_setting = 0;
+    switch_cap_relay(relay_setting);
+    step_cap_motor(RETURN_START_MODE);
+    step_ind_motor(RETURN_START_MODE);
+    homing_saved_ms = 0;
+    tune_homed = 1;
+}
+
+
+// Record the benchmark report for the finished tune, save the converged solution
+// for the current frequency if it meets the target and release the tune request.
+// A solution that misses the target clears the frequency from tune memory, so a
+// later tune does not drive to it.
+void complete_tune(_iq16 final_gamma)
+{
+    tune_solution_t solution;
+
+    __bic_SR_register(GIE); // The stepper interrupt counts the steps
+    tune_report.cap_steps = cap_motor_steps - cap_steps_start;
+    tune_report.ind_steps = ind_motor_steps - ind_steps_start;
+    __bis_SR_register(GIE);
+    tune_report.duration_ms = (uint16_t)(((system_ticks() - tune_start) * 1000) / 32768);
+    tune_report.probes = fine_tune_probes;
+    tune_report.fine_tune_ms = fine_tune_ms;
+    tune_report.homing_saved_ms = homing_saved_ms;
+    tune_report.final_vswr = vswr_from_gamma(final_gamma);
+    tune_report.restarts = tune_restarts;
+    tune_report.agc_locked = agc_locked;
+    tune_restarts = 0;
+    tune_count++;
+
+    solution.cap_position = cap_sample;
+    solution.ind_position = ind_sample;
+    solution.relay_setting = relay_setting;
+    solution.net_side = net_side;
+    if(final_gamma <= target_gamma) { tune_memory_store(frequency, &solution); }
+    else { tune_memory_forget(frequency); }
+
+    tune_task = INITIALIZE_TUNE_COMPONENTS;
+    button_press &= ~TUNE & ~MODE_LOCK;
+}
+
+
+// Begin a joint pattern search for the SWR minimum around the current motor positions.
+void start_pattern_search(void)
+{
+    center_cap = cap_sample;
+    center_ind = ind_sample;
+    probe_cap = center_cap;
+    probe_ind = center_ind;
+    search_step = FINE_TUNE_START_STEP;
+    search_dir = 0;
+    fine_tune_probes = 0;
+    search_start = system_ticks();
+    search_state = SEARCH_SETTLE; // Measure the starting point first
+}
+
+
+// Run one step of the pattern search. Each probe moves both motors at once to a
+// point around the current best, diagonals first since L and C interact. A better
+// point becomes the new center, and once no direction improves the step is halved.
+// The search ends as soon as the target SWR is met. Returns 1 when finished.
+uint8_t pattern_search(void)
+{
+    static const int8_t cap_dir[8] = { 1, -1,  1, -1,  1, -1,  0,  0 };
+    static const int8_t ind_dir[8] = { 1, -1, -1,  1,  0,  0,  1, -1 };
+    int16_t next;
+    _iq16 gamma;
+
+    switch(search_state)
+    {
+        case SEARCH_MOVE:
+        {
+            step_cap_motor((probe_cap << 4) | CMD_POS_MODE);
+            step_ind_motor((probe_ind << 4) | CMD_POS_MODE);
+            search_state = SEARCH_SETTLE;
+            break;
+        }
+
+        case SEARCH_SETTLE:
+        {
+            if(task_flag & MOTOR_ACTIVE) { break; }
+            discard_swr_pairs(); // Only use readings taken at the probe point
+            search_state = SEARCH_MEASURE;
+            break;
+        }
+
+        case SEARCH_MEASURE:
+        {
+            gamma = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
+            if(gamma == 0) { break; }
+            fine_tune_probes++;
+            if((fine_tune_probes == 1) || (gamma < best_gamma)) {
+                best_gamma = gamma;
+                center_cap = probe_cap;
+                center_ind = probe_ind;
+            } else { search_dir++; }
+
+            if((best_gamma <= target_gamma) || (fine_tune_probes >= FINE_TUNE_MAX_PROBES)) {
+                search_state = SEARCH_RETURN_TO_BEST;
+                break;
+            }
+
+            // Find the next probe that stays within the limits of both components
+            while(1)
+            {
+                if(search_dir == 8) {
+                    search_step >>= 1;
+                    search_dir = 0;
+                }
+                if(search_step < FINE_TUNE_MIN_STEP) { break; }
+
+                next = (int16_t)center_cap + (cap_dir[search_dir] * (int16_t)search_step);
+                if(next < C_LOWER_LIMIT) { next = C_LOWER_LIMIT; }
+                if(next > C_UPPER_LIMIT) { next = C_UPPER_LIMIT; }
+                probe_cap = (uint16_t)next;
+                next = (int16_t)center_ind + (ind_dir[search_dir] * (int16_t)search_step);
+                if(next < L_LOWER_LIMIT) { next = L_LOWER_LIMIT; }
+                if(next > L_UPPER_LIMIT) { next = L_UPPER_LIMIT; }
+                probe_ind = (uint16_t)next;
+
+                if((probe_cap != center_cap) || (probe_ind != center_ind)) { break; }
+                search_dir++;
+            }
+            if(search_step < FINE_TUNE_MIN_STEP) { search_state = SEARCH_RETURN_TO_BEST; }
+            else { search_state = SEARCH_MOVE; }
+            break;
+        }
+
+        case SEARCH_RETURN_TO_BEST:
+        {
+            if((probe_cap != center_cap) || (probe_ind != center_ind)) {
+                step_cap_motor((center_cap << 4) | CMD_POS_MODE);
+                step_ind_motor((center_ind << 4) | CMD_POS_MODE);
+            }
+            search_state = SEARCH_DONE;
+            break;
+        }
+
+        case SEARCH_DONE:
+        {
+            if(task_flag & MOTOR_ACTIVE) { break; }
+            fine_tune_ms = (uint16_t)(((system_ticks() - search_start) * 1000) / 32768);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
 // TODO: Change clock speed to 24MHz.
 void clock_configure(void)
 {
@@ -20,6 +20,7 @@
 #define IMP_SWITCH                  BIT0
 #define SWR_SENSE                   BIT1
 #define SWR_KNOWN_SENSE             BIT2
+#define ADC_UNDER_RANGE             BIT3
 #define CAP_POT                     BIT4
 #define IND_POT                     BIT5
 #define ADC_STATUS                  BIT6
@@ -27,12 +28,88 @@
 #define REF_PIN                     ADCINCH_11
 #define IND_PIN                     ADCINCH_9
 #define CAP_PIN                     ADCINCH_8
+// Macros for ADC acquisition, tick counts are Timer0 (SMCLK / 8, 3 MHz) ticks
+#define ADC_MODE_SINGLE             0   // Timer stepped single conversions
+#define ADC_MODE_SEQUENCE           1   // REF, FWD, IND, CAP as one channel sequence
+#define ADC_START_TICKS             6000 // First conversion 2 ms after initialization
+#define ADC_SETTLE_TICKS            183 // Channel RC settling before a single conversion
+#define ADC_INTERVAL_TICKS          366 // Delay between single conversions
+#define ADC_SEQ_INTERVAL_TICKS      183 // Delay between channel sequences
+#define ADC_SEQ_REPEAT_TICKS        45  // Delay after a single channel sequence
+#define ADC_SEQ_SHT                 ADCSHT_4 // 64 ADC clocks (13 us) per channel in a sequence
+// Macros for ADC oversampling filter
+#define ADC_FILTER_NONE             0   // Raw conversions
+#define ADC_FILTER_CIC              1   // Accumulate and dump, one output per 2^shift conversions
+#define ADC_FILTER_MA               2   // Moving average of the last 2^shift conversions
+#define ADC_FILTER_MAX_SHIFT        4
+#define ADC_FILTER_LEN              (1 << ADC_FILTER_MAX_SHIFT)
+#define ADC_HIRES(x)                ((uint16_t)(x) << ADC_FILTER_MAX_SHIFT) // 12-bit to filter output scale
+#define ADC_RING_SIZE               32  // Pair records between the ADC interrupt and tasks, power of 2
+#define ADC_RING_FRESH_TICKS        328 // Records older than 10 ms are skipped by the SWR display
+#define ADC_HI_LIMIT                4090 // Window comparator, FWD/REF above backs off the digipot
+#define ADC_LO_LIMIT                2000 // Window comparator, FWD below requests more gain
+// Macros for the digipot AGC. ADC voltage is taken as proportional to (256 - code).
+#define AGC_TARGET                  3000 // FWD reading the AGC aims for, 12-bit
+#define AGC_CODE_MAX                0xFF // Lowest gain
+// Macros for detector linearization. Tables are indexed by detector output at
+// full gain (ADC_HIRES reading / digipot gain), with one point per octave.
+#define DET_FWD                     0
+#define DET_REF                     1
+#define DET_TABLE_POINTS            17  // Octaves from 2^DET_TABLE_BASE_SHIFT to 2^24
+#define DET_TABLE_BASE_SHIFT        8
+// Macros for the division free reciprocal. Entries are 2^20 / k for k = 32 ... 64,
+// so a mantissa normalized to [2^15, 2^16) gives 2^30 / mantissa.
+#define RECIP_ENTRY(k)              ((uint16_t)((1UL << 20) / (k)))
+#define RECIP_ENTRIES4(k)           RECIP_ENTRY(k), RECIP_ENTRY((k) + 1), RECIP_ENTRY((k) + 2), RECIP_ENTRY((k) + 3)
+#define RECIP_TABLE_POINTS          33
+#define VSWR_MAX                    0x7FFFFFFF // Reported for a total reflection
+// Macros for adaptive ADC scheduling in sequence mode
+#define ADC_SEG_ALL                 0   // REF, FWD, IND, CAP
+#define ADC_SEG_SWR                 1   // REF, FWD
+#define ADC_SEG_POTS                2   // IND, CAP
+#define ADC_SEG_IND                 3   // IND
+#define ADC_SEG_CAP                 4   // CAP
+#define ADC_SCHED_SLOTS             4   // Sequences per schedule cycle
+#define ADC_RF_PRESENT_MIN          ADC_HIRES(64) // FWD at full gain taken as carrier present
+// Macros for the reciprocal frequency counter
+#define FREQ_IDLE                   0   // Stopped, no signal
+#define FREQ_GATE                   1   // Gates running back to back
+#define FREQ_PRESCALE               16  // Input divided by ID_2 and TBIDEX_3 ahead of Timer1
+#define FREQ_TIMEBASE_HZ            3000000UL // Timer0 clock
+#define FREQ_HZ_SCALE               (FREQ_PRESCALE * FREQ_TIMEBASE_HZ) // Hz from edges / Timer0 ticks
+#define FREQ_GATE_TICKS             96000 // Gates last between half of this and this, 32 ms
+#define FREQ_COUNT_MIN              64  // Gate length in Timer1 counts while acquiring
+#define FREQ_COUNT_MAX              0xF000 // Longest gate, leaves the closing edge room before Timer1 wraps
+#define FREQ_MIN_TICKS              3000 // Gates under 1 ms are left out of the average
+#define FREQ_HISTORY_SIZE           8   // Closed gates kept, power of 2
+#define FREQ_SMOOTH_GATES           4   // Latest gates summed for the smoothed frequency
+#define FREQ_TIMEOUT_TICKS          3277 // Timer3 ticks, 100 ms without the gate closing is no signal
+#define FREQ_SYNC_LOOPS             64  // Timer1 reads while waiting for an edge
+#define FREQ_HYSTERESIS_DEFAULT     10  // kHz a new frequency must differ by to count as a change
+#define FREQ_HYSTERESIS_MIN         1   // Settings menu range, kHz
+#define FREQ_HYSTERESIS_MAX         100
+#define FREQ_CHANGE_GATES           2   // Consecutive gates beyond the hysteresis to accept a change
+// Fixed point scales applied to the frequency in Hz with a 32 x 32 multiply and
+// keeping the upper word, in place of a 32-bit divide
+#define FREQ_KHZ_SCALE              4294968UL // 2^32 / 1000, rounded up
+#define FREQ_HZ_TO_KHZ(hz)          ((uint32_t)((((uint64_t)(hz) + 500) * FREQ_KHZ_SCALE) >> 32))
+#define FREQ_OMEGA_SCALE            ((uint32_t)(2.0 * PI * 65536.0 * 4294.967296 + 0.5)) // 2 pi 2^16 2^32 / 10^6
+#define FREQ_HZ_TO_OMEGA(hz)        ((_iq16)(((uint64_t)(hz) * FREQ_OMEGA_SCALE) >> 32)) // Mrad/s in Q16
+// Macros for carrier detect, checked every 10 ms
+#define RF_EVENT_RISE               BIT0
+#define RF_EVENT_FALL               BIT1
+#define CARRIER_RISE_CHECKS         2   // Checks with frequency and FWD both present to report a carrier
+#define CARRIER_FALL_CHECKS         5   // Checks with either missing to report it gone
+#define TUNE_NO_RF_TICKS            65536 // Timer3 ticks, a tune without carrier for 2 s is cancelled
 // Macros for task flags
 #define A_TASK                      BIT0
 #define B_TASK                      BIT1
 #define C_TASK                      BIT2
 #define MOTOR_ACTIVE                BIT3
 #define REVERT_TO_BTN_MODE          BIT4
+#define CAP_MOTOR_ACTIVE            BIT5
+#define IND_MOTOR_ACTIVE            BIT6
+#define RF_PRESENT                  BIT7 // Carrier detected, set by update_carrier()
 // Macros for Stepper Motors
 #define CAPACITOR_MOTOR             1
 #define INDUCTOR_MOTOR              0
@@ -41,6 +118,9 @@
 #define INCREASE_CAP_DIR            1
 #define DECREASE_CAP_DIR            0
 #define STEP_DUTY_CYCLE             12000
+#define STEP_PERIOD_TICKS           48   // STEP_HIGH + STEP_LOW in ACLK ticks
+#define CAP_MOTOR_STEPS             5373
+#define IND_MOTOR_STEPS             6200
 #define SET_ENABLE_AND_DIRECTION    0
 #define STEP_HIGH                   1
 #define STEP_LOW                    2
@@ -49,17 +129,30 @@
 #define L_UPPER_LIMIT               4090
 #define C_LOWER_LIMIT               0005
 #define C_UPPER_LIMIT               4090
+#define C_RELAY_STEP                3839 // 470pF relay step in varicap positions
+#define C_VARICAP_MIN               245  // 30pF minimum varicap in positions
 #define BTN_CONTROL_MODE            2
 #define RETURN_START_MODE           4
 #define CMD_POS_MODE                8
-#define FINE_TUNE_MODE              10
+#define LINE_SEARCH_MODE            12
+#define LINE_SEARCH_WINDOW          128  // Default half width of line search bracket
+#define LINE_SEARCH_TOLERANCE       4
+#define GOLDEN_RATIO_256            158  // 0.618 * 256
+#define LS_PROBE_A                  0
+#define LS_PROBE_B                  1
 #define Lup_CMD                     3
 #define Ldn_CMD                     2
 #define Cup_CMD                     3
 #define Cdn_CMD                     2
+// Macros for network configuration
+#define CAP_OUTPUT_SIDE             0
+#define CAP_INPUT_SIDE              1
 // Macros for SWR sense
 #define KNOWN_SWITCHED_OUT          0
 #define KNOWN_SWITCHED_IN           1
+#define KNOWN_IMPEDANCE             25.0 // Series impedance switched in by P3.6, in ohms
+#define SOURCE_IMPEDANCE            50.0
+#define INVERT_MAX                  100.0 // Largest normalized impedance the solver inverts
 // Macros for tune task algorithm
 #define INITIALIZE_TUNE_COMPONENTS  0
 #define CALCULATE_SWR               1
@@ -67,6 +160,21 @@
 #define ESTIMATE_TUNE_VALUES        3
 #define ADJUST_TO_ESTIMATES         4
 #define FINE_TUNE                   5
+#define VERIFY_RECALL               6
+#define REFINE_RECALL               7
+#define RECALL_REFINE_WINDOW        64
+#define CHECK_ESTIMATE              8
+#define REPORT_TUNE                 9
+// Macros for fine tune pattern search
+#define FINE_TUNE_START_STEP        64
+#define FINE_TUNE_MIN_STEP          4
+#define FINE_TUNE_MAX_PROBES        64
+#define INCREMENTAL_GAMMA_MAX       0.8 // Reflection above which a tune homes before estimating
+#define SEARCH_MOVE                 0
+#define SEARCH_SETTLE               1
+#define SEARCH_MEASURE              2
+#define SEARCH_RETURN_TO_BEST       3
+#define SEARCH_DONE                 4
 // Macros for the push button flag
 #define TUNE                        BIT0
 #define MODE                        BIT1
@@ -79,69 +187,230 @@
 // Macros for UI menus
 #define SETTING_MENU_OFFSET         20
 #define NUM_QUICK_MENUS             3
-#define NUM_SETUP_MENUS             3
+#define NUM_SETUP_MENUS             4
 #define DEFAULT_DISPLAY             1
 #define TUNING_DISPLAY              2
 #define COMPONENT_VALUES            3
 #define TARGET_SWR                  21
 #define AUTOTUNE_THRESH             22
 #define LC_DISPLAY                  23
+#define FREQ_HYSTERESIS             24
 #define DEFAULT_QUICK_MENU          DEFAULT_DISPLAY
 #define DEFAULT_SETTING_MENU        TARGET_SWR
+// Macros for tune memory
+#define TUNE_MEM_ENTRIES            64
+#define TUNE_MEM_BIN_KHZ            25
+#define TUNE_MEM_EMPTY              0
+#define TUNE_MEM_BIN_MAX            0xFFFF // Bins are 16 bits, higher frequencies share the last
+#define TUNE_MEM_INTERP_SPAN_SHIFT  5   // Neighbours at most 1/32 of the frequency apart
+#define NO_RECALL                   0
+#define STORED_RECALL               1
+#define INTERPOLATED_RECALL         2
+// Macros for tune settings, SWR values in tenths
+#define TARGET_SWR_DEFAULT          15
+#define TARGET_SWR_MIN              15
+#define TARGET_SWR_MAX              20
+#define THRESHOLD_SWR_OFF           0
+#define THRESHOLD_SWR_MAX           30
+#define AUTOTUNE_DEBOUNCE           5   // Readings above threshold before tuning
+#define AUTOTUNE_HOLDOFF            500 // B2 passes after a tune before retriggering
 // Macros for other
 #define CAP_MAX                     3790.00 // in pF
 #define IND_MAX                     24.6    // in uH
 
 
+// Types
+typedef struct
+{
+    uint16_t freq_bin;          // Frequency bin, TUNE_MEM_EMPTY when unused
+    uint16_t cap_position;      // Capacitor pot reading of converged solution
+    uint16_t ind_position;      // Inductor pot reading of converged solution
+    uint8_t relay_setting;      // Binary capacitor relay setting
+    uint8_t net_side;           // Capacitor side of inductor (P3.4)
+} tune_solution_t;
+
+typedef struct
+{
+    _iq16 resistance;           // Load resistance in ohms
+    _iq16 reactance;            // Magnitude of load reactance in ohms, sign unknown
+    _iq16 inductance[2];        // Network inductance in uH for a +jX and -jX load
+    _iq16 capacitance[2];       // Network capacitance in pF for a +jX and -jX load
+    uint8_t net_side[2];        // Capacitor side of inductor for each candidate
+    uint8_t valid[2];           // Candidate network is within the component ranges
+} load_solution_t;
+
+typedef struct
+{
+    uint32_t cap_steps;         // Capacitor motor steps taken during the tune
+    uint32_t ind_steps;         // Inductor motor steps taken during the tune
+    uint16_t duration_ms;       // Time from tune request to converged result
+    uint16_t probes;            // SWR probes taken by the fine tune
+    uint16_t fine_tune_ms;      // Time spent in the fine tune, 0 if it did not run
+    uint16_t homing_saved_ms;   // Homing time skipped by starting from the current position
+    _iq16 final_vswr;           // VSWR measured at the converged position
+    uint8_t recall;             // Tune memory path taken (NO_RECALL, ...)
+    uint8_t restarts;           // Restarts after the frequency changed mid tune
+    uint8_t agc_locked;         // ADC gain was locked when the final SWR was measured
+} tune_report_t;
+
+typedef struct
+{
+    uint32_t sum;               // Sum of the conversions in the current window
+    uint16_t window[ADC_FILTER_LEN]; // Conversions in the window, moving average only
+    uint8_t index;              // Next window slot to replace
+    uint8_t count;              // Conversions accumulated since the last output or reset
+} adc_filter_t;
+
+typedef struct
+{
+    uint16_t fwd;               // Filtered FWD reading of the pair, ADC_HIRES scale
+    uint16_t ref;               // Filtered REF reading converted back to back with fwd
+    uint16_t timestamp;         // Timer3 count when the pair completed
+    uint16_t seq;               // Incremented each time a pair is published
+    uint8_t gain_epoch;         // AGC gain epoch both readings were taken in
+    uint8_t gain_code;          // Digipot code on the wiper for both readings
+} swr_pair_t;
+
+typedef struct
+{
+    uint16_t timestamp;         // Timer3 count when the pair completed
+    uint16_t fwd;               // Filtered FWD reading, ADC_HIRES scale
+    uint16_t ref;               // Filtered REF reading, ADC_HIRES scale
+    uint8_t known_switched;     // Pair was taken with the known impedance switched in
+    uint8_t gain_epoch;         // AGC gain epoch the pair was taken in
+    uint8_t gain_code;          // Digipot code on the wiper for the pair
+} adc_record_t;
+
+typedef struct
+{
+    uint16_t timestamp;         // Timer3 count when the gate closed
+    uint16_t edges;             // Timer1 counts in the gate
+    uint32_t ticks;             // Gate time in Timer0 ticks
+} freq_record_t;
+
+typedef struct
+{
+    uint16_t seq;               // Incremented each time new results are published
+    _iq16 vswr;                 // Most recent VSWR reading
+    _iq16 resistance;           // Estimated load resistance in ohms
+    _iq16 capacitance;          // Estimated network capacitance in pF
+    _iq16 inductance;           // Estimated network inductance in uH
+} tune_snapshot_t;
+
+typedef struct
+{
+    uint16_t lower, upper;      // Current bracket around the SWR minimum
+    uint16_t probe_a, probe_b;  // Interior golden section points, probe_a < probe_b
+    _iq16 gamma_a, gamma_b;     // Reflection coefficient measured at each probe
+    uint8_t measuring;          // Probe currently being measured
+    uint8_t primed;             // Both interior probes have been measured
+    uint8_t at_probe;           // Motor has arrived and waits for a fresh reading
+} line_search_t;
+
+
 // Globals
-extern uint32_t  total_pulses;
-extern uint16_t frequency, overflowCount, inductor_position, capacitor_position;
-extern uint16_t cap_sample, ind_sample, fwd_sample,
-                ref_sample, fwd_25_sample, ref_25_sample;
-extern uint8_t adc_channel_select, adc_flg, task_flag,
+extern uint32_t frequency, freq_latest;
+extern uint16_t inductor_position, capacitor_position, homing_saved_ms;
+extern uint16_t cap_sample, ind_sample, adc_ring_overruns;
+extern uint16_t fine_tune_probes, fine_tune_ms, tune_count, a_task_wcet;
+extern uint32_t cap_motor_steps, ind_motor_steps;
+extern tune_report_t tune_report;
+extern tune_snapshot_t tune_snapshot;
+extern volatile uint16_t timer3_overflows, timer0_overflows;
+extern uint8_t adc_channel_select, adc_mode, adc_filter_type, adc_filter_shift, adc_flg, task_flag,
                display_menu, cap_motor_task, ind_motor_task,
-               tune_task, button_press, relay_setting;
-extern char cap2_val[8];
-extern char ind2_val[6];
-extern char swr_val[5];
-extern char load_imp[7];
+               tune_task, button_press, relay_setting, net_side,
+               target_swr, threshold_swr, seq_gain_epoch;
 
 
 // Subsystem function declarations
 extern void tune(void);
+extern void start_pattern_search(void);
+extern uint8_t pattern_search(void);
+
+// Impedance solver subsystem
+extern uint8_t solve_load_impedance(_iq16 gamma_out, _iq16 gamma_in, _iq16 angular_frequency,
+                                    const tune_solution_t *network, load_solution_t *load);
+extern void network_to_positions(const load_solution_t *load, uint8_t candidate,
+                                 tune_solution_t *positions);
 
 // Stepper motor subsystem
 extern void initialize_stepper_control(void);
 extern void step_cap_motor(uint16_t command);
 extern void step_ind_motor(uint16_t command);
+extern void stop_motors(void);
+extern uint8_t positions_plausible(void);
+extern uint16_t line_search_start(line_search_t *search, uint16_t center, uint16_t lower_limit,
+                                  uint16_t upper_limit, uint16_t half_width);
+extern uint8_t line_search_update(line_search_t *search, _iq16 gamma, uint16_t *next);
+extern uint16_t homing_time_ms(void);
 extern void current_setting(void);
 
 // Frequency Counter subsystem
 extern void measure_freq(void);
 extern void initialize_freq_counter(void);
+extern void freq_gate_timeout(void);
+extern volatile freq_record_t freq_history[FREQ_HISTORY_SIZE];
+extern volatile uint8_t freq_history_head;
+extern uint16_t freq_hysteresis;
+extern uint8_t frequency_moved(uint32_t reference);
 
 // Standing Wave Ratio subsystem
 extern _iq16 calculate_ref_coeff(uint8_t reflection_to_calc);
+extern void discard_swr_pairs(void);
 extern void initialize_spi(void);
 extern void initialize_adc(void);
 extern void update_digipot(void);
+extern void write_digipot(uint8_t code);
+extern void digipot_back_off(void);
+extern void digipot_write_complete(void);
+extern volatile uint8_t spi_busy;
+extern uint8_t wiper_code;
+extern uint32_t detector_table[2][DET_TABLE_POINTS];
+extern uint32_t linearize_detector(uint8_t channel, uint16_t reading, uint8_t gain_code);
+extern void set_detector_point(uint8_t channel, uint8_t index, uint32_t value);
+extern _iq16 reflection_ratio(uint32_t ref, uint32_t fwd);
+extern _iq16 vswr_from_gamma(_iq16 gamma);
+extern volatile uint8_t agc_epoch;
+extern uint8_t agc_locked;
 extern void update_swr(void);
+extern void update_carrier(void);
+extern uint8_t rf_events;
+extern void set_adc_mode(uint8_t mode);
+extern void get_swr_pair(uint8_t reflection_to_calc, swr_pair_t *pair);
+extern void set_adc_filter(uint8_t type, uint8_t shift);
+extern uint8_t adc_ring_count(void);
+extern uint8_t adc_ring_peek(uint8_t index, adc_record_t *record);
+extern uint8_t adc_ring_read(adc_record_t *record);
+extern void adc_ring_discard(void);
 
 // User Interface subsystem
 extern void ui_init(void);
 extern void lcd_update(void);
 extern void utoa(unsigned int n, char s[]);
 extern void reverse(char s[]);
+extern void adjust_setting(int8_t direction);
+extern _iq16 swr_setting(uint8_t tenths);
 
 // Relay subsystem
 extern void initialize_relay(void);
 extern void switch_cap_relay(uint8_t setting);
-extern void switch_net_config(void);
+extern void switch_net_config(uint8_t side);
 extern void switch_known_impedance(void);
 
+// Tune memory subsystem
+extern uint16_t fram_write_enable(void);
+extern void fram_write_restore(uint16_t protection);
+extern uint8_t tune_memory_recall(uint32_t freq_hz, tune_solution_t *solution);
+extern uint8_t tune_memory_interpolate(uint32_t freq_hz, tune_solution_t *solution);
+extern void tune_memory_store(uint32_t freq_hz, const tune_solution_t *solution);
+extern void tune_memory_forget(uint32_t freq_hz);
+
 // State Machine function prototypes
 //------------------------------------
 extern void initialize_task_manager(void);
+extern uint32_t system_ticks(void);
+extern void idle_until_task(void);
 
 // Variable declarations for state machine
 extern void (*Alpha_State_Ptr)(void);  // Base States pointer
@@ -13,10 +13,14 @@
 // Function Prototypes
 void initialize_relay(void);
 void switch_cap_relay(uint8_t setting);
-void switch_net_config(void);
+void switch_net_config(uint8_t side);
 void switch_kwown_impedance(void);
 
 
+// Globals
+uint8_t net_side = CAP_OUTPUT_SIDE;
+
+
 // TODO: Initialize relay outputs
 void initialize_relay(void)
 {
@@ -65,11 +69,12 @@ void switch_cap_relay(uint8_t setting)
 }
 
 
-// TODO: Function to switch capacitor to either side of inductor.
-void switch_net_config(void)
+// Function to switch capacitor to either side of inductor.
+void switch_net_config(uint8_t side)
 {
-    // Not Implemented
-    asm("    NOP");
+    if(side == CAP_INPUT_SIDE) { P3OUT |= BIT4; } // Capacitors switched to input side.
+    else { P3OUT &= ~BIT4; } // Capacitors switched to output side.
+    net_side = side;
 }
 
 
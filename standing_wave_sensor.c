@@ -9,6 +9,22 @@
  *              another function will regulate the digipot on the SWR board to protect
  *              the launchpad from voltage inputs above its rating.
  *
+ *              The diode detectors are not linear at low power, so FWD and REF readings
+ *              pass through a per channel linearization table before their ratio is
+ *              taken. Each table holds the true detector voltage at one point per
+ *              octave of detector output, and is kept in FRAM so it can be calibrated.
+ *              The default tables are the identity.
+ *
+ *              Reflection coefficient and VSWR are found without division. The divisor
+ *              is normalized to a 16-bit mantissa and its reciprocal interpolated from
+ *              a 33 entry table generated by the preprocessor, so each probe costs a
+ *              few multiplies and shifts.
+ *
+ *              Carrier detect needs both a running frequency count and FWD above
+ *              ADC_RF_PRESENT_MIN, referred to full gain. It sets RF_PRESENT in
+ *              task_flag and posts rise and fall events in rf_events. Without a
+ *              carrier, the SWR math and the AGC stand down.
+ *
  *              Important side note: digital potentiometer should be connected as follows:
  *              A terminal to ground
  *              B terminal to 1.5V
@@ -22,60 +38,193 @@
 // Function Prototypes
 void initialize_spi(void);
 void update_digipot(void);
+void write_digipot(uint8_t code);
+void digipot_write_complete(void);
+void digipot_back_off(void);
 _iq16 calculate_ref_coeff(uint8_t reflection_to_calc);
+void discard_swr_pairs(void);
 void update_swr(void);
+void update_carrier(void);
+uint32_t linearize_detector(uint8_t channel, uint16_t reading, uint8_t gain_code);
+void set_detector_point(uint8_t channel, uint8_t index, uint32_t value);
+_iq16 reflection_ratio(uint32_t ref, uint32_t fwd);
+_iq16 vswr_from_gamma(_iq16 gamma);
 
 // Globals
-uint8_t DATA_BYTE = 0x80;
+uint8_t DATA_BYTE = 0x80; // Digipot code, higher is lower ADC gain
+volatile uint8_t agc_epoch = 0; // Incremented on every completed digipot write
+uint8_t agc_locked = 0; // FWD sits inside the window at the current gain
 const uint8_t CMD_BYTE = 0x13;
+volatile uint8_t spi_busy = 0; // Digipot transfer in progress
+static uint8_t spi_data, spi_byte; // Data byte and position of the transfer in progress
+static uint8_t spi_pending = 0, spi_pending_code; // Code waiting for the bus
+uint8_t wiper_code = 0x80; // Code on the digipot wiper, mid scale at power up
+uint8_t rf_events = 0; // RF_EVENT_RISE and RF_EVENT_FALL, cleared by their consumers
+static uint16_t swr_seq_used = 0, swr_known_seq_used = 0; // Last pairs calculate_ref_coeff() used
+// Detector linearization, true voltage at detector outputs of 2^8, 2^9 ... 2^24
+#define DET_IDENTITY_TABLE { 0x100, 0x200, 0x400, 0x800, 0x1000, 0x2000, 0x4000, 0x8000, 0x10000, \
+                             0x20000, 0x40000, 0x80000, 0x100000, 0x200000, 0x400000, 0x800000, 0x1000000 }
+static const uint16_t recip_table[RECIP_TABLE_POINTS] = {
+    RECIP_ENTRIES4(32), RECIP_ENTRIES4(36), RECIP_ENTRIES4(40), RECIP_ENTRIES4(44),
+    RECIP_ENTRIES4(48), RECIP_ENTRIES4(52), RECIP_ENTRIES4(56), RECIP_ENTRIES4(60),
+    RECIP_ENTRY(64)
+};
+#pragma PERSISTENT(detector_table)
+uint32_t detector_table[2][DET_TABLE_POINTS] = { DET_IDENTITY_TABLE, DET_IDENTITY_TABLE };
+
+
+// Return the position of the highest set bit of a nonzero value, found with a
+// fixed five step search.
+static uint8_t highest_bit(uint32_t x)
+{
+    uint8_t bit = 0;
+
+    if(x >> 16) { bit += 16; x >>= 16; }
+    if(x >> 8)  { bit += 8;  x >>= 8; }
+    if(x >> 4)  { bit += 4;  x >>= 4; }
+    if(x >> 2)  { bit += 2;  x >>= 2; }
+    if(x >> 1)  { bit += 1; }
+    return bit;
+}
+
+
+// Return 2^30 / mantissa for a mantissa in [2^15, 2^16), interpolated between
+// the table entries. Relative error is below 0.03 %.
+static uint16_t reciprocal(uint16_t mantissa)
+{
+    uint8_t i = (mantissa >> 10) - 32;
+    uint16_t frac = mantissa & 0x03FF;
+
+    return recip_table[i] - (uint16_t)(((uint32_t)(recip_table[i] - recip_table[i + 1]) * frac) >> 10);
+}
+
+
+// Reflection coefficient ref / fwd in Q16 without division. Both values are
+// shifted so fwd falls in [2^15, 2^16), then ref is scaled by the reciprocal.
+_iq16 reflection_ratio(uint32_t ref, uint32_t fwd)
+{
+    uint8_t bit;
+
+    if(fwd == 0) { return 0; }
+    if(ref >= fwd) { return _IQ16(1.0) - 1; } // Total reflection, or noise on it
+    bit = highest_bit(fwd);
+    if(bit > 15) { fwd >>= bit - 15; ref >>= bit - 15; }
+    else { fwd <<= 15 - bit; ref <<= 15 - bit; }
+    return (_iq16)((ref * reciprocal((uint16_t)fwd)) >> 14);
+}
+
+
+// VSWR (1 + G) / (1 - G) in Q16 without division, as 2 / (1 - G) - 1.
+_iq16 vswr_from_gamma(_iq16 gamma)
+{
+    uint32_t d = _IQ16(1.0) - gamma; // 1 - G in Q16
+    uint32_t vswr;
+    uint8_t bit;
+
+    if(gamma <= 0) { return _IQ16(1.0); }
+    if(d == 0) { return VSWR_MAX; }
+    bit = highest_bit(d);
+    if(bit < 2) { return VSWR_MAX; } // Beyond the Q16 range
+    // 2^32 / d = reciprocal(d << (15 - bit)) << (17 - bit), doubled for 2 / (1 - G)
+    vswr = (uint32_t)reciprocal((uint16_t)(d << (15 - bit))) << (18 - bit);
+    if(vswr > VSWR_MAX) { return VSWR_MAX; }
+    return (_iq16)(vswr - _IQ16(1.0));
+}
+
+
+// Convert a FWD or REF reading (ADC_HIRES scale) taken at the given digipot code
+// to true detector voltage. The reading is referred back to full gain, its octave
+// found with a fixed five step search and the table interpolated within it.
+uint32_t linearize_detector(uint8_t channel, uint16_t reading, uint8_t gain_code)
+{
+    const uint32_t *table = detector_table[channel];
+    uint32_t detector, x;
+    uint16_t span = AGC_CODE_MAX + 1 - gain_code;
+    uint8_t octave;
+    int32_t slope;
+
+    // reading * 256 / span, using the reciprocal of span normalized to 16 bits
+    octave = highest_bit(span);
+    detector = ((uint32_t)reading * reciprocal(span << (15 - octave))) >> (7 + octave);
+    if(detector < (1UL << DET_TABLE_BASE_SHIFT)) {
+        return (detector * table[0]) >> DET_TABLE_BASE_SHIFT; // Below the table, scale toward zero
+    }
+
+    octave = highest_bit(detector);
+    if(octave >= DET_TABLE_BASE_SHIFT + DET_TABLE_POINTS - 1) { return table[DET_TABLE_POINTS - 1]; }
+
+    table += octave - DET_TABLE_BASE_SHIFT;
+    slope = (int32_t)(table[1] - table[0]);
+    x = (detector - (1UL << octave)) >> (octave - DET_TABLE_BASE_SHIFT); // 8-bit fraction of the octave
+    return table[0] + (uint32_t)(((int64_t)slope * x) >> DET_TABLE_BASE_SHIFT);
+}
+
+
+// Set one calibration point: the true detector voltage for a detector output of
+// 2^(DET_TABLE_BASE_SHIFT + index), in the same units as the identity table.
+void set_detector_point(uint8_t channel, uint8_t index, uint32_t value)
+{
+    uint16_t protection;
+
+    if((channel > DET_REF) || (index >= DET_TABLE_POINTS)) { return; }
+    protection = fram_write_enable();
+    detector_table[channel][index] = value;
+    fram_write_restore(protection);
+}
 
 
 // TODO: Implement SWR measurement function
+// Return the reflection coefficient of the latest pair for the given impedance
+// setting, or 0 if no pair has been published since the last one used. Pairs
+// are told apart by their sequence numbers, so the ADC flags are left alone.
 _iq16 calculate_ref_coeff(uint8_t reflection_to_calc)
 {
-    _iq19 numerator, denominator, reflection_coefficient;
+    swr_pair_t pair;
+    uint16_t *used;
+
     switch(reflection_to_calc)
     {
         case KNOWN_SWITCHED_IN:
-        {
-            if(adc_flg & SWR_KNOWN_SENSE)
-            {
-                adc_flg &= ~SWR_KNOWN_SENSE;
-                numerator = _IQ19(ref_25_sample);
-                denominator = _IQ19(fwd_25_sample);
-                reflection_coefficient = _IQ19div(numerator, denominator);
-                return _IQ19toIQ(reflection_coefficient);
-            } else {
-                return 0;
-            }
-        }
-
+            used = &swr_known_seq_used;
+            break;
         case KNOWN_SWITCHED_OUT:
-        {
-            if(adc_flg & SWR_SENSE)
-            {
-                adc_flg &= ~SWR_SENSE;
-                numerator = _IQ19(ref_sample);
-                denominator = _IQ19(fwd_sample);
-                reflection_coefficient = _IQ19div(numerator, denominator);
-                return _IQ19toIQ(reflection_coefficient);
-            } else {
-                return 0;
-            }
-        }
+            used = &swr_seq_used;
+            break;
         default:
             return 0;
     }
+    get_swr_pair(reflection_to_calc, &pair);
+    if(pair.seq == *used) { return 0; }
+    *used = pair.seq;
+    return reflection_ratio(linearize_detector(DET_REF, pair.ref, pair.gain_code),
+                            linearize_detector(DET_FWD, pair.fwd, pair.gain_code));
+}
+
+
+// Mark every pair published so far as used, so calculate_ref_coeff() waits for
+// a pair completed after this call.
+void discard_swr_pairs(void)
+{
+    swr_pair_t pair;
+
+    get_swr_pair(KNOWN_SWITCHED_OUT, &pair);
+    swr_seq_used = pair.seq;
+    get_swr_pair(KNOWN_SWITCHED_IN, &pair);
+    swr_known_seq_used = pair.seq;
 }
 
 
 // TODO: Init SPI function for digital potentiometer
+// The module is left running with loopback enabled, since there is no MISO line
+// the looped back byte marks the end of each transfer. Transfers are driven by
+// the receive interrupt, see write_digipot().
 void initialize_spi(void)
 {
     // Configure P4.4 as output for Chip Select Line,
     // P4.5 as UCB1CLK and P4.6 as UCB1SIMO
     P4DIR |= BIT4 | BIT5 | BIT6;
     P4SEL0 |= BIT5 | BIT6;
+    P4OUT |= BIT4; // De-select digi pot
 
     // Stop USCI
     UCB1CTLW0 |= UCSWRST;
@@ -84,64 +233,219 @@ void initialize_spi(void)
     // Use SMCLK at 16 MHz
     UCB1CTLW0 |= UCSSEL__SMCLK + UCMODE_0 + UCMST + UCSYNC + UCMSB + UCCKPH;
     UCB1BRW |= 0x10; //1 MHz SPI clock = SMCLK / 16
+    UCB1STATW |= UCLISTEN;  //Enable loopback mode since no MISO line
+
+    UCB1CTLW0 &= ~UCSWRST; //Start USCI
+    UCB1IE |= UCRXIE; // Receive interrupt marks each byte complete
 }
 
 
-// TODO: Change digipot for safe ADC voltages
-void update_digipot(void)
+// Select the digipot and send the command byte. The receive interrupt sends
+// the data byte and ends the transfer.
+static void spi_start(uint8_t code)
 {
-    uint8_t update_needed = 0;
-    if((fwd_sample > 4090) || (ref_sample > 4090))
-    {
-        DATA_BYTE++; // Increase resistance to lower voltage
-        update_needed = 1;
-    } else if((DATA_BYTE != 0) && ((fwd_sample < 4050) || (ref_sample < 4050)))
+    spi_busy = 1;
+    spi_data = code;
+    spi_byte = 0;
+    P4OUT &= ~BIT4; //Pull select line low on P4.4
+    UCB1TXBUF = CMD_BYTE; //Load data into transmit buffer
+}
+
+
+// Queue a wiper code for the digipot and return at once. If a transfer is in
+// progress, the code is sent when it finishes, replacing any code already
+// waiting since only the latest setting matters. digipot_write_complete() is
+// called from the interrupt once the code is on the wiper. Call from the ADC
+// interrupt or with interrupts disabled.
+void write_digipot(uint8_t code)
+{
+    if(spi_busy)
     {
-        DATA_BYTE--; // Decrease resistance to increase voltage
-        update_needed = 1;
+        spi_pending_code = code;
+        spi_pending = 1;
+        return;
     }
-    if(update_needed)
-    {
-        volatile unsigned char LoopBack_cmd;
-        volatile unsigned char LoopBack_data;
+    spi_start(code);
+}
 
-        P4OUT &= ~BIT4; //Pull select line low on P4.4
-        UCB1STATW |= UCLISTEN;  //Enable loopback mode since no MISO line
-        UCB1CTLW0 &= ~UCSWRST; //Start USCI
 
+// A new wiper code has been written, readings from here on use the new gain.
+void digipot_write_complete(void)
+{
+    agc_epoch++;
+}
 
-        // First write the Command Byte
-        while (!(UCB1IFG & UCTXIFG)); //Check if it is OK to write
-        UCB1TXBUF = CMD_BYTE; //Load data into transmit buffer
 
-        while (!(UCB1IFG & UCRXIFG)); //Wait until complete RX byte is received
-        LoopBack_cmd = UCB1RXBUF; //Read buffer to clear RX flag
+// Change the digipot code. The gain epoch moves on when the write completes, so
+// pairs and filters taken at the old gain are not mixed with the new one. Must be
+// called with interrupts disabled or from the ADC interrupt.
+static void agc_set_code(uint8_t code)
+{
+    if(code == DATA_BYTE) { return; }
+    DATA_BYTE = code;
+    agc_locked = 0;
+    write_digipot(code);
+}
 
-        // Then write the Data Byte
-        while (!(UCB1IFG & UCTXIFG)); //Check if it is OK to write
-        UCB1TXBUF = DATA_BYTE; //Load data into transmit buffer
 
-        while (!(UCB1IFG & UCRXIFG)); //Wait until complete RX byte is received
-        LoopBack_data = UCB1RXBUF; //Read buffer to clear RX flag
+// Halve the ADC gain. Called from the ADC interrupt when FWD or REF is over
+// range, where the true level is unknown, so the gain is binary searched down.
+// Conversions made while a back off is still being written, or that started at
+// an older gain, are ignored, so one overload backs off once per gain epoch.
+void digipot_back_off(void)
+{
+    if(spi_busy || (seq_gain_epoch != agc_epoch)) { return; }
+    if(DATA_BYTE == AGC_CODE_MAX) { return; } // Already at the lowest gain
+    agc_set_code(DATA_BYTE + ((AGC_CODE_MAX + 1 - DATA_BYTE + 1) >> 1));
+}
 
 
-        UCB1CTLW0 |= UCSWRST; //Stop USCI
-        UCB1STATW &= ~UCLISTEN;  //Disable loopback mode
-        P4OUT |= BIT4; //De-select digi pot on SPI
+// TODO: Change digipot for safe ADC voltages
+// Over range is handled by the ADC interrupt. When the window comparator flags an
+// under range FWD reading, jump straight to the code that brings FWD to
+// AGC_TARGET, using the level measured at the current gain. Lock is reported
+// once a pair at the current gain lands inside the window.
+void update_digipot(void)
+{
+    swr_pair_t pair;
+    uint16_t fwd;
+    uint32_t span;
+
+    if(rf_events & RF_EVENT_RISE) {
+        rf_events &= ~RF_EVENT_RISE;
+        agc_locked = 0; // Level of the new carrier is unknown
     }
+    if(!(task_flag & RF_PRESENT)) { return; } // Nothing to regulate
+    if(spi_busy) { return; } // Previous code still being written
+    get_swr_pair(KNOWN_SWITCHED_OUT, &pair);
+    if(pair.gain_epoch != agc_epoch) { return; } // Wait for a pair at the current gain
+    fwd = pair.fwd >> ADC_FILTER_MAX_SHIFT;
+    if((fwd >= ADC_LO_LIMIT) && (fwd <= ADC_HI_LIMIT)) { agc_locked = 1; }
+    if(!(adc_flg & ADC_UNDER_RANGE)) { return; }
+
+    // Voltage scales with (256 - code), so scale that span by target / measured
+    span = AGC_CODE_MAX + 1 - DATA_BYTE;
+    if(fwd == 0) { span = AGC_CODE_MAX + 1; }
+    else { span = (span * AGC_TARGET) / fwd; }
+    if(span > AGC_CODE_MAX + 1) { span = AGC_CODE_MAX + 1; }
+    if(span == 0) { span = 1; }
+
+    __bic_SR_register(GIE); // The ADC interrupt also writes the digipot
+    if(fwd < ADC_LO_LIMIT) { agc_set_code(AGC_CODE_MAX + 1 - span); }
+    adc_flg &= ~ADC_UNDER_RANGE; // Comparator re-arms on the next FWD conversion
+    __bis_SR_register(GIE);
 }
 
 
 // TODO: Update SWR reading from most recent ADC values
 void update_swr(void)
 {
-    static const _iq16 iq_one = _IQ16(1.0);
-    uint8_t error = 0;
-    _iq16 numerator, denominator, vswr;
-    _iq16 reflection_coefficient = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
+    static uint8_t readings_above = 0;
+    static uint16_t holdoff = 0;
+    _iq16 vswr, reflection_coefficient;
+    uint32_t fwd_sum = 0, ref_sum = 0;
+    uint8_t count = 0;
+    adc_record_t record;
+
+    if(holdoff) { holdoff--; } // Not called while tuning, so this counts from the end of a tune
+    if(rf_events & RF_EVENT_FALL) {
+        rf_events &= ~RF_EVENT_FALL;
+        readings_above = 0;
+        tune_snapshot.vswr = 0; // Blank the SWR display
+        tune_snapshot.seq++;
+    }
+    if(!(task_flag & RF_PRESENT)) {
+        adc_ring_discard(); // The readings are noise
+        return;
+    }
+
+    // Average the recent pairs in the ADC ring for a steadier reading
+    while(adc_ring_read(&record))
+    {
+        if(record.known_switched || (record.gain_epoch != agc_epoch)) { continue; }
+        if((uint16_t)(TB3R - record.timestamp) > ADC_RING_FRESH_TICKS) { continue; }
+        fwd_sum += linearize_detector(DET_FWD, record.fwd, record.gain_code);
+        ref_sum += linearize_detector(DET_REF, record.ref, record.gain_code);
+        count++;
+    }
+    if(count == 0) { return; }
+    reflection_coefficient = reflection_ratio(ref_sum, fwd_sum); // Ratio of sums is the ratio of means
     if(reflection_coefficient == 0) { return; }
-    numerator = iq_one + reflection_coefficient;
-    denominator = iq_one - reflection_coefficient;
-    vswr = _IQ16div(numerator, denominator);
-    error += _IQ16toa(swr_val,"%2.1f", vswr);
+    vswr = vswr_from_gamma(reflection_coefficient);
+    tune_snapshot.vswr = vswr;
+    tune_snapshot.seq++;
+
+    // Start a tune on our own once the SWR has stayed above the threshold
+    if((threshold_swr == THRESHOLD_SWR_OFF) || (vswr <= swr_setting(threshold_swr))) {
+        readings_above = 0;
+        return;
+    }
+    if(readings_above < AUTOTUNE_DEBOUNCE) { readings_above++; }
+    if((readings_above == AUTOTUNE_DEBOUNCE) && (holdoff == 0) && !(button_press & MODE_LOCK)) {
+        button_press |= TUNE | MODE_LOCK;
+        readings_above = 0;
+        holdoff = AUTOTUNE_HOLDOFF;
+    }
+}
+
+
+// Track carrier presence from the frequency counter and the FWD level. Presence
+// must hold for CARRIER_RISE_CHECKS calls to be reported and absence for
+// CARRIER_FALL_CHECKS, so a short dropout does not stop the work it gates.
+void update_carrier(void)
+{
+    static uint8_t checks = 0;
+    swr_pair_t pair;
+    uint8_t present;
+
+    get_swr_pair(KNOWN_SWITCHED_OUT, &pair);
+    present = (frequency != 0) &&
+              (linearize_detector(DET_FWD, pair.fwd, pair.gain_code) >= ADC_RF_PRESENT_MIN);
+    if(present == ((task_flag & RF_PRESENT) != 0)) {
+        checks = 0;
+        return;
+    }
+    checks++;
+    if(present && (checks >= CARRIER_RISE_CHECKS)) {
+        task_flag |= RF_PRESENT;
+        rf_events = (rf_events & ~RF_EVENT_FALL) | RF_EVENT_RISE;
+        checks = 0;
+    } else if(!present && (checks >= CARRIER_FALL_CHECKS)) {
+        task_flag &= ~RF_PRESENT;
+        rf_events = (rf_events & ~RF_EVENT_RISE) | RF_EVENT_FALL;
+        checks = 0;
+    }
+}
+
+
+// Directive for eUSCI_B1 SPI interrupt
+#pragma vector = USCI_B1_VECTOR
+__interrupt void USCI_B1_ISR(void)
+{
+    volatile unsigned char LoopBack_data;
+
+    switch(__even_in_range(UCB1IV, USCI_SPI_UCTXIFG))
+    {
+    case USCI_SPI_UCRXIFG: // A byte has been shifted out
+        LoopBack_data = UCB1RXBUF; //Read buffer to clear RX flag
+        if(spi_byte == 0)
+        {
+            spi_byte = 1;
+            UCB1TXBUF = spi_data; // Then write the Data Byte
+            break;
+        }
+        P4OUT |= BIT4; //De-select digi pot on SPI
+        wiper_code = spi_data;
+        spi_busy = 0;
+        digipot_write_complete();
+        if(spi_pending)
+        {
+            spi_pending = 0;
+            spi_start(spi_pending_code);
+        }
+        break;
+
+    default:
+        break;
+    }
 }
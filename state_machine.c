@@ -15,6 +15,8 @@
 
 // Function Prototypes
 void initialize_task_manager(void);
+uint32_t system_ticks(void);
+void idle_until_task(void);
 // Alpha states
 void A0(void);  //state A0
 void B0(void);  //state B0
@@ -44,6 +46,7 @@ void (*C_Task_Ptr)(void);       // State pointer C branch
 
 //Globals
 uint8_t task_flag = 0;
+uint16_t a_task_wcet = 0; // Longest A task execution seen, in Timer0 ticks of 1/3 us
 
 
 // TODO: Create timer interrupt that will execute next task once previous task is completed.
@@ -66,6 +69,29 @@ void initialize_task_manager(void)
 }
 
 
+// Read the 32-bit ACLK time base formed by Timer3 and its overflow count.
+// Must be called with interrupts enabled so a pending overflow is counted.
+uint32_t system_ticks(void)
+{
+    uint16_t high, low;
+    do {
+        high = timer3_overflows;
+        low = TB3R;
+    } while(high != timer3_overflows);
+    return ((uint32_t)high << 16) | low;
+}
+
+
+// Sleep in LPM0 until the Timer3 interrupt flags the next task. Interrupts are
+// disabled across the check so a flag set just before sleeping is not missed.
+void idle_until_task(void)
+{
+    __bic_SR_register(GIE);
+    if(task_flag & (A_TASK | B_TASK | C_TASK)) { __bis_SR_register(GIE); }
+    else { __bis_SR_register(LPM0_bits | GIE); }
+}
+
+
 // TODO: Implement all state machine routines
 //=================================================================================
 //  STATE-MACHINE SEQUENCING AND SYNCRONIZATION FOR SLOW BACKGROUND TASKS
@@ -73,14 +99,20 @@ void initialize_task_manager(void)
 
 void A0(void)
 {
+    uint16_t start, elapsed;
+
     // loop rate synchronizer for A-tasks
     if(task_flag & A_TASK)
     {
         task_flag &= ~A_TASK; // Clear flag
 
+        // Timed on Timer0 at 3 MHz, a Timer3 tick is longer than most A tasks
+        start = TB0R;
         //-----------------------------------------------------------
         (*A_Task_Ptr)();        // jump to an A Task (A1,A2,A3,...)
         //-----------------------------------------------------------
+        elapsed = TB0R - start;
+        if(elapsed > a_task_wcet) { a_task_wcet = elapsed; }
     }
     Alpha_State_Ptr = &B0;      // Comment out to allow only A tasks
 }
@@ -111,6 +143,7 @@ void C0(void)
         (*C_Task_Ptr)();        // jump to a C Task (C1,C2,C3,...)
         //-----------------------------------------------------------
     }
+    if(!(task_flag & RF_PRESENT)) { idle_until_task(); } // Nothing to sense, sleep until the next task
 
     Alpha_State_Ptr = &A0;  // Back to State A0
 }
@@ -151,6 +184,8 @@ void A2(void)
 void B1(void)
 //----------------------------------------
 {
+    measure_freq();
+    update_carrier();
     update_digipot();
     //-----------------
     //the next time Timer3 counter 2 reaches period value go to B2
@@ -165,7 +200,14 @@ void B2(void) //  SPARE
     if(!(button_press & TUNE) && !(task_flag & MOTOR_ACTIVE))
     {
         update_swr();
-        if(button_press & Lup)
+        if((display_menu == TARGET_SWR) || (display_menu == AUTOTUNE_THRESH) || (display_menu == FREQ_HYSTERESIS))
+        {
+            // Up and down buttons adjust the setting on display, once per press
+            if(button_press & (Lup | Cup)) { adjust_setting(1); }
+            else if(button_press & (Ldn | Cdn)) { adjust_setting(-1); }
+            button_press &= ~Lup & ~Cup & ~Ldn & ~Cdn;
+        }
+        else if(button_press & Lup)
         {
             step_ind_motor(Lup_CMD);
             task_flag |= MOTOR_ACTIVE;
@@ -182,6 +224,8 @@ void B2(void) //  SPARE
             step_cap_motor(Cdn_CMD);
             task_flag |= MOTOR_ACTIVE;
         }
+    } else {
+        adc_ring_discard(); // Readings taken while tuning or moving are not the load's SWR
     }
     //-----------------
     //the next time Timer3 counter 2 reaches period value go to B3
@@ -214,7 +258,6 @@ void C1(void)
 void C2(void) //  SPARE
 //----------------------------------------
 {
-    measure_freq();
     //-----------------
     //the next time Timer3 counter 3 reaches period value go to C3
     C_Task_Ptr = &C1;
@@ -16,11 +16,19 @@
 void initialize_stepper_control(void);
 void step_cap_motor(uint16_t command);
 void step_ind_motor(uint16_t command);
+void stop_motors(void);
+uint8_t positions_plausible(void);
+uint16_t line_search_start(line_search_t *search, uint16_t center, uint16_t lower_limit,
+                           uint16_t upper_limit, uint16_t half_width);
+uint8_t line_search_update(line_search_t *search, _iq16 gamma, uint16_t *next);
+uint16_t homing_time_ms(void);
 
 
 // Globals
 uint8_t cap_motor_task = 0;
 uint8_t ind_motor_task = 0;
+uint32_t cap_motor_steps = 0; // Running step counts, used for tune reports
+uint32_t ind_motor_steps = 0;
 
 
 // TODO: Initialize stepper control
@@ -84,8 +92,8 @@ inline void step_cap_motor(uint16_t command)
      *
      */
 
-    static uint16_t position, fine_lower, fine_upper;
-    static _iq16 minimum_swr;
+    static uint16_t position;
+    static line_search_t search;
     static uint8_t direction, mode;
     uint8_t step_status;
     _iq16 current_swr;
@@ -102,15 +110,14 @@ inline void step_cap_motor(uint16_t command)
             break;
         case CMD_POS_MODE:
             position = (command >> 4);
-            if(position < cap_sample) { direction = INCREASE_CAP_DIR; }
+            if(position > cap_sample) { direction = INCREASE_CAP_DIR; }
             else { direction = DECREASE_CAP_DIR; }
             break;
-        case FINE_TUNE_MODE:
-            fine_lower = cap_sample - 128;
-            fine_upper = cap_sample + 128;
-            if(fine_lower < C_LOWER_LIMIT) { fine_lower = C_LOWER_LIMIT; }
-            if(fine_upper > C_UPPER_LIMIT) { fine_upper = C_UPPER_LIMIT; }
-            direction = DECREASE_CAP_DIR;
+        case LINE_SEARCH_MODE:
+            if((command >> 4) == 0) { command |= (LINE_SEARCH_WINDOW << 4); }
+            position = line_search_start(&search, cap_sample, C_LOWER_LIMIT, C_UPPER_LIMIT, command >> 4);
+            if(position > cap_sample) { direction = INCREASE_CAP_DIR; }
+            else { direction = DECREASE_CAP_DIR; }
             break;
         default:
             return;
@@ -147,7 +154,7 @@ inline void step_cap_motor(uint16_t command)
     {
         case SET_ENABLE_AND_DIRECTION:
         {
-            task_flag |= MOTOR_ACTIVE;
+            task_flag |= MOTOR_ACTIVE | CAP_MOTOR_ACTIVE;
             P5OUT &= ~BIT4; // Enable FETs on driver
             if(direction) { P1OUT &= ~BIT4; }
             else { P1OUT |= BIT4; }
@@ -175,8 +182,8 @@ inline void step_cap_motor(uint16_t command)
                 }
                 case CMD_POS_MODE:
                 {
-                    if((position < cap_sample) && (direction == INCREASE_CAP_DIR)) { step_status = 1; }
-                    else if((position > cap_sample) && (direction == DECREASE_CAP_DIR)) { step_status = 1; }
+                    if((position > cap_sample) && (direction == INCREASE_CAP_DIR)) { step_status = 1; }
+                    else if((position < cap_sample) && (direction == DECREASE_CAP_DIR)) { step_status = 1; }
                     else {
                         if(task_flag & REVERT_TO_BTN_MODE) {
                             task_flag &= ~ REVERT_TO_BTN_MODE;
@@ -184,44 +191,53 @@ inline void step_cap_motor(uint16_t command)
                             if(button_press & Cup) { direction = INCREASE_CAP_DIR; }
                             else if(button_press & Cdn) { direction = DECREASE_CAP_DIR; }
                             cap_motor_task = SET_ENABLE_AND_DIRECTION;
-                            TB2CCR2  = TB2R + 2;
+                            TB2CCR1  = TB2R + 2;
                             return;
                         }
                         step_status = 0;
                     }
                     break;
                 }
-                case FINE_TUNE_MODE:
+                case LINE_SEARCH_MODE:
                 {
-                    if((cap_sample <= fine_lower) && (direction != INCREASE_CAP_DIR)) {
-                        direction = INCREASE_CAP_DIR;
-                        cap_motor_task = SET_ENABLE_AND_DIRECTION;
-                        TB2CCR2  = TB2R + 2;
-                        return;
-                    } else if(cap_sample >= fine_upper) {
-                        mode = CMD_POS_MODE;
-                        if(position < cap_sample) {
-                            direction = DECREASE_CAP_DIR;
-                            cap_motor_task = SET_ENABLE_AND_DIRECTION;
+                    if((position > cap_sample) && (direction == INCREASE_CAP_DIR)) { step_status = 1; }
+                    else if((position < cap_sample) && (direction == DECREASE_CAP_DIR)) { step_status = 1; }
+                    else {
+                        // At the probe point, hold position until a reading taken here arrives
+                        if(!search.at_probe) {
+                            discard_swr_pairs();
+                            search.at_probe = 1;
+                            TB2CCR1  = TB2R + 8;
+                            return;
                         }
-                        TB2CCR2  = TB2R + 2;
-                        return;
-                    } else {
-                        step_status = 1;
                         current_swr = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
-                        if((current_swr < minimum_swr) && (current_swr != 0)) {
-                            minimum_swr = current_swr;
-                            position = cap_sample;
+                        if(current_swr == 0) {
+                            TB2CCR1  = TB2R + 8;
+                            return;
                         }
+                        search.at_probe = 0;
+                        if(line_search_update(&search, current_swr, &position)) {
+                            mode = CMD_POS_MODE; // Bracket closed, finish at the best probe
+                        }
+                        if(position > cap_sample) { direction = INCREASE_CAP_DIR; }
+                        else { direction = DECREASE_CAP_DIR; }
+                        cap_motor_task = SET_ENABLE_AND_DIRECTION;
+                        TB2CCR1  = TB2R + 2;
+                        return;
                     }
+                    break;
                 }
                 default:
                     return;
             }
-            if(step_status == 0) { cap_motor_task = DISABLE_DRIVER; }
+            if(step_status == 0) {
+                cap_motor_task = DISABLE_DRIVER;
+                TB2CCR1  = TB2R + 2; // Disable now, not after a timer wrap
+            }
             else if(step_status == 1)
             {
                 P1OUT |= BIT1;
+                cap_motor_steps++;
                 TB2CCR1  = TB2R + 24;
                 cap_motor_task = STEP_LOW;
             }
@@ -240,7 +256,8 @@ inline void step_cap_motor(uint16_t command)
             P5OUT |= BIT4; // Disable FETs on driver
             cap_motor_task = SET_ENABLE_AND_DIRECTION;
             TB2CCTL1 = CCIE_0;
-            task_flag &= ~MOTOR_ACTIVE;
+            task_flag &= ~CAP_MOTOR_ACTIVE;
+            if(!(task_flag & IND_MOTOR_ACTIVE)) { task_flag &= ~MOTOR_ACTIVE; }
             break;
         }
     }
@@ -263,8 +280,8 @@ inline void step_ind_motor(uint16_t command)
      *
      */
 
-    static uint16_t position, fine_lower, fine_upper;
-    static _iq16 minimum_swr;
+    static uint16_t position;
+    static line_search_t search;
     static uint8_t direction, mode;
     uint8_t step_status;
     _iq16 current_swr;
@@ -281,16 +298,14 @@ inline void step_ind_motor(uint16_t command)
             break;
         case CMD_POS_MODE:
             position = (command >> 4);
-            if(position < ind_sample) { direction = INCREASE_IND_DIR; }
+            if(position > ind_sample) { direction = INCREASE_IND_DIR; }
             else { direction = DECREASE_IND_DIR; }
             break;
-        case FINE_TUNE_MODE:
-            minimum_swr = _IQ16(100.00);
-            fine_lower = ind_sample - 128;
-            fine_upper = ind_sample + 128;
-            if(fine_lower < L_LOWER_LIMIT) { fine_lower = L_LOWER_LIMIT; }
-            if(fine_upper > L_UPPER_LIMIT) { fine_upper = L_UPPER_LIMIT; }
-            direction = DECREASE_IND_DIR;
+        case LINE_SEARCH_MODE:
+            if((command >> 4) == 0) { command |= (LINE_SEARCH_WINDOW << 4); }
+            position = line_search_start(&search, ind_sample, L_LOWER_LIMIT, L_UPPER_LIMIT, command >> 4);
+            if(position > ind_sample) { direction = INCREASE_IND_DIR; }
+            else { direction = DECREASE_IND_DIR; }
             break;
         default:
             return;
@@ -307,7 +322,7 @@ inline void step_ind_motor(uint16_t command)
     {
         case SET_ENABLE_AND_DIRECTION:
         {
-            task_flag |= MOTOR_ACTIVE;
+            task_flag |= MOTOR_ACTIVE | IND_MOTOR_ACTIVE;
             P3OUT &= ~BIT2; // Enable FETs on driver
             if(direction) { P2OUT &= ~BIT4; }
             else { P2OUT |= BIT4; }
@@ -335,42 +350,51 @@ inline void step_ind_motor(uint16_t command)
                 }
                 case CMD_POS_MODE:
                 {
-                    if((position < ind_sample) && (direction == INCREASE_IND_DIR)) { step_status = 1; }
-                    else if((position > ind_sample) && (direction == DECREASE_IND_DIR)) { step_status = 1; }
+                    if((position > ind_sample) && (direction == INCREASE_IND_DIR)) { step_status = 1; }
+                    else if((position < ind_sample) && (direction == DECREASE_IND_DIR)) { step_status = 1; }
                     else { step_status = 0; }
                     break;
                 }
-                case FINE_TUNE_MODE:
+                case LINE_SEARCH_MODE:
                 {
-                    if((ind_sample <= fine_lower) && (direction != INCREASE_IND_DIR)) {
-                        direction = INCREASE_IND_DIR;
-                        ind_motor_task = SET_ENABLE_AND_DIRECTION;
-                        TB2CCR2  = TB2R + 2;
-                        return;
-                    } else if(ind_sample >= fine_upper) {
-                        mode = CMD_POS_MODE;
-                        if(position < ind_sample) {
-                            direction = DECREASE_IND_DIR;
-                            ind_motor_task = SET_ENABLE_AND_DIRECTION;
+                    if((position > ind_sample) && (direction == INCREASE_IND_DIR)) { step_status = 1; }
+                    else if((position < ind_sample) && (direction == DECREASE_IND_DIR)) { step_status = 1; }
+                    else {
+                        // At the probe point, hold position until a reading taken here arrives
+                        if(!search.at_probe) {
+                            discard_swr_pairs();
+                            search.at_probe = 1;
+                            TB2CCR2  = TB2R + 8;
+                            return;
                         }
-                        TB2CCR2  = TB2R + 2;
-                        return;
-                    } else {
-                        step_status = 1;
                         current_swr = calculate_ref_coeff(KNOWN_SWITCHED_OUT);
-                        if((current_swr < minimum_swr) && (current_swr != 0)) {
-                            minimum_swr = current_swr;
-                            position = ind_sample;
+                        if(current_swr == 0) {
+                            TB2CCR2  = TB2R + 8;
+                            return;
+                        }
+                        search.at_probe = 0;
+                        if(line_search_update(&search, current_swr, &position)) {
+                            mode = CMD_POS_MODE; // Bracket closed, finish at the best probe
                         }
+                        if(position > ind_sample) { direction = INCREASE_IND_DIR; }
+                        else { direction = DECREASE_IND_DIR; }
+                        ind_motor_task = SET_ENABLE_AND_DIRECTION;
+                        TB2CCR2  = TB2R + 2;
+                        return;
                     }
+                    break;
                 }
                 default:
                     return;
             }
-            if(step_status == 0) { ind_motor_task = DISABLE_DRIVER; }
+            if(step_status == 0) {
+                ind_motor_task = DISABLE_DRIVER;
+                TB2CCR2  = TB2R + 2; // Disable now, not after a timer wrap
+            }
             else if(step_status == 1)
             {
                 P1OUT |= BIT3;
+                ind_motor_steps++;
                 TB2CCR2  = TB2R + 24;
                 ind_motor_task = STEP_LOW;
             }
@@ -389,13 +413,125 @@ inline void step_ind_motor(uint16_t command)
             P3OUT |= BIT2; // Disable FETs on driver
             ind_motor_task = SET_ENABLE_AND_DIRECTION;
             TB2CCTL2 = CCIE_0;
-            task_flag &= ~MOTOR_ACTIVE;
+            task_flag &= ~IND_MOTOR_ACTIVE;
+            if(!(task_flag & CAP_MOTOR_ACTIVE)) { task_flag &= ~MOTOR_ACTIVE; }
             break;
         }
     }
 }
 
 
+// Stop both motors where they are by running their DISABLE_DRIVER step now.
+void stop_motors(void)
+{
+    __bic_SR_register(GIE);
+    if(task_flag & CAP_MOTOR_ACTIVE) {
+        cap_motor_task = DISABLE_DRIVER;
+        step_cap_motor(0);
+    }
+    if(task_flag & IND_MOTOR_ACTIVE) {
+        ind_motor_task = DISABLE_DRIVER;
+        step_ind_motor(0);
+    }
+    __bis_SR_register(GIE);
+}
+
+
+// Check that both position pots have been sampled and read within their travel.
+// A reading outside the limits points to a disconnected or shorted wiper.
+uint8_t positions_plausible(void)
+{
+    if((adc_flg & (CAP_POT | IND_POT)) != (CAP_POT | IND_POT)) { return 0; }
+    if((cap_sample < C_LOWER_LIMIT) || (cap_sample > C_UPPER_LIMIT)) { return 0; }
+    if((ind_sample < L_LOWER_LIMIT) || (ind_sample > L_UPPER_LIMIT)) { return 0; }
+    return 1;
+}
+
+
+// Estimate the time needed to return both motors to their lower limits from the
+// current positions. Both motors home together, so the slower one sets the time.
+// Returns 0 when the pot readings cannot be trusted.
+uint16_t homing_time_ms(void)
+{
+    uint32_t cap_ticks, ind_ticks;
+
+    if(!positions_plausible()) { return 0; } // A sample below the limit would wrap
+    cap_ticks = (uint32_t)(cap_sample - C_LOWER_LIMIT) * CAP_MOTOR_STEPS * STEP_PERIOD_TICKS;
+    cap_ticks /= (C_UPPER_LIMIT - C_LOWER_LIMIT);
+    ind_ticks = (uint32_t)(ind_sample - L_LOWER_LIMIT) * IND_MOTOR_STEPS * STEP_PERIOD_TICKS;
+    ind_ticks /= (L_UPPER_LIMIT - L_LOWER_LIMIT);
+
+    if(ind_ticks > cap_ticks) { cap_ticks = ind_ticks; }
+    return (uint16_t)((cap_ticks * 1000) / 32768);
+}
+
+
+// Open a golden section line search bracket of half_width positions around the
+// center, clipped to the component limits. Returns the first probe position.
+uint16_t line_search_start(line_search_t *search, uint16_t center, uint16_t lower_limit,
+                           uint16_t upper_limit, uint16_t half_width)
+{
+    uint16_t span;
+
+    search->lower = (center > (lower_limit + half_width)) ? (center - half_width) : lower_limit;
+    search->upper = (center < (upper_limit - half_width)) ? (center + half_width) : upper_limit;
+    span = ((uint32_t)(search->upper - search->lower) * GOLDEN_RATIO_256) >> 8;
+    search->probe_a = search->upper - span;
+    search->probe_b = search->lower + span;
+    search->measuring = LS_PROBE_A;
+    search->primed = 0;
+    search->at_probe = 0;
+    return search->probe_a;
+}
+
+
+// Record the reflection coefficient measured at the current probe and shrink the
+// bracket toward the lower of the two interior probes. Each step reuses one probe,
+// so only one new measurement is needed per step. Writes the next position to
+// visit in next. Returns 1 once the bracket is within LINE_SEARCH_TOLERANCE, in
+// which case next holds the best probe found.
+uint8_t line_search_update(line_search_t *search, _iq16 gamma, uint16_t *next)
+{
+    uint16_t span;
+
+    if(search->measuring == LS_PROBE_A) { search->gamma_a = gamma; }
+    else { search->gamma_b = gamma; }
+
+    if(!search->primed) {
+        search->primed = 1;
+        search->measuring = LS_PROBE_B;
+        *next = search->probe_b;
+        return 0;
+    }
+
+    if((search->upper - search->lower) <= LINE_SEARCH_TOLERANCE) {
+        *next = (search->gamma_a < search->gamma_b) ? search->probe_a : search->probe_b;
+        return 1;
+    }
+
+    if(search->gamma_a < search->gamma_b) {
+        // Minimum lies between lower and probe_b
+        search->upper = search->probe_b;
+        search->probe_b = search->probe_a;
+        search->gamma_b = search->gamma_a;
+        span = ((uint32_t)(search->upper - search->lower) * GOLDEN_RATIO_256) >> 8;
+        search->probe_a = search->upper - span;
+        search->measuring = LS_PROBE_A;
+        *next = search->probe_a;
+    } else {
+        // Minimum lies between probe_a and upper
+        search->lower = search->probe_a;
+        search->probe_a = search->probe_b;
+        search->gamma_a = search->gamma_b;
+        span = ((uint32_t)(search->upper - search->lower) * GOLDEN_RATIO_256) >> 8;
+        search->probe_b = search->lower + span;
+        search->measuring = LS_PROBE_B;
+        *next = search->probe_b;
+    }
+    return 0;
+}
+
+
 #pragma vector=TIMER2_B1_VECTOR
 __interrupt void Timer2_B1(void)
 {
@@ -0,0 +1,208 @@
+/*
+ * File: tune_memory.c
+ *
+ * Author(s): Preston Peranich
+ *
+ * Description: This file will contain the functions to store and recall converged
+ *              tuning solutions. Solutions are kept in a table in FRAM so that they
+ *              survive power cycles, and are keyed by frequency bins derived from the
+ *              frequency counter. Callers pass the frequency in Hz; bins and the
+ *              interpolation work in kHz. When a tune is requested in a known bin, the tune
+ *              algorithm can drive straight to the stored solution instead of running
+ *              the full estimate and fine tune sequence. Between stored points, a
+ *              solution is predicted from the neighbouring entries and used to seed
+ *              the fine tune.
+ *
+ *              Writes to the table are bracketed by fram_write_enable() and
+ *              fram_write_restore(). The host build places the table in RAM and
+ *              SYSCFG0 in the register shim, see host/tests/test_tune_memory.c.
+ *
+ ******************************************************************************/
+
+#include "intellitune.h"
+
+
+// Function Prototypes
+uint16_t fram_write_enable(void);
+void fram_write_restore(uint16_t protection);
+uint8_t tune_memory_recall(uint32_t freq_hz, tune_solution_t *solution);
+uint8_t tune_memory_interpolate(uint32_t freq_hz, tune_solution_t *solution);
+void tune_memory_store(uint32_t freq_hz, const tune_solution_t *solution);
+void tune_memory_forget(uint32_t freq_hz);
+
+
+// Globals
+// Table of stored solutions. A freq_bin of TUNE_MEM_EMPTY marks an unused entry.
+#pragma PERSISTENT(tune_memory)
+tune_solution_t tune_memory[TUNE_MEM_ENTRIES] = {0};
+// Next entry to overwrite once the table is full
+#pragma PERSISTENT(tune_memory_next)
+uint8_t tune_memory_next = 0;
+
+
+// Convert a frequency in kHz to its tune memory bin.
+static uint16_t tune_memory_bin(uint32_t freq)
+{
+    uint32_t bin = (freq / TUNE_MEM_BIN_KHZ) + 1; // Offset so bin 0 can mark an empty entry
+
+    return (bin > TUNE_MEM_BIN_MAX) ? TUNE_MEM_BIN_MAX : (uint16_t)bin;
+}
+
+
+// Convert a tune memory bin back to the frequency at its center in kHz.
+static uint32_t tune_memory_bin_center(uint16_t bin)
+{
+    return ((uint32_t)(bin - 1) * TUNE_MEM_BIN_KHZ) + (TUNE_MEM_BIN_KHZ / 2);
+}
+
+
+// Interpolate a reactance product between two neighbours. The product of a
+// position and frequency is constant for a fixed reactance, so interpolating it
+// linearly in frequency tracks the L/C values a fixed load needs as the
+// frequency moves between the stored points.
+static uint16_t interpolate_position(uint32_t freq, uint32_t freq_lo, uint16_t pos_lo,
+                                     uint32_t freq_hi, uint16_t pos_hi)
+{
+    int64_t react_lo = (int64_t)pos_lo * freq_lo;
+    int64_t react_hi = (int64_t)pos_hi * freq_hi;
+    int64_t react = react_lo + ((react_hi - react_lo) * (int64_t)(freq - freq_lo)) / (int64_t)(freq_hi - freq_lo);
+    return (uint16_t)(react / freq);
+}
+
+
+// Remove program FRAM write protection. Returns previous protection setting.
+uint16_t fram_write_enable(void)
+{
+    uint16_t protection = SYSCFG0 & 0x00FF;
+    SYSCFG0 = FRWPPW | (protection & ~PFWP);
+    return protection;
+}
+
+
+// Restore program FRAM write protection saved by fram_write_enable().
+void fram_write_restore(uint16_t protection)
+{
+    SYSCFG0 = FRWPPW | protection;
+}
+
+
+// Look up a stored solution for the given frequency. Returns 1 if one was found.
+uint8_t tune_memory_recall(uint32_t freq_hz, tune_solution_t *solution)
+{
+    uint8_t i;
+    uint16_t bin;
+    uint32_t freq = FREQ_HZ_TO_KHZ(freq_hz);
+
+    if(freq < TUNE_MEM_BIN_KHZ) { return 0; } // No valid frequency measured
+    bin = tune_memory_bin(freq);
+
+    for(i = 0; i < TUNE_MEM_ENTRIES; i++)
+    {
+        if(tune_memory[i].freq_bin == bin)
+        {
+            *solution = tune_memory[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Predict a solution for the given frequency from the nearest stored neighbours
+// on either side. Capacitance is linearized across the relay bank before
+// interpolating and split back into relay setting and varicap position after.
+// Returns 1 if a prediction was made.
+uint8_t tune_memory_interpolate(uint32_t freq_hz, tune_solution_t *solution)
+{
+    uint8_t i, lo = TUNE_MEM_ENTRIES, hi = TUNE_MEM_ENTRIES;
+    uint16_t bin, cap_lo, cap_hi, cap;
+    uint32_t freq_lo, freq_hi, freq = FREQ_HZ_TO_KHZ(freq_hz);
+
+    if(freq < TUNE_MEM_BIN_KHZ) { return 0; }
+    bin = tune_memory_bin(freq);
+
+    for(i = 0; i < TUNE_MEM_ENTRIES; i++)
+    {
+        if(tune_memory[i].freq_bin == TUNE_MEM_EMPTY) { continue; }
+        if(tune_memory[i].freq_bin < bin) {
+            if((lo == TUNE_MEM_ENTRIES) || (tune_memory[i].freq_bin > tune_memory[lo].freq_bin)) { lo = i; }
+        } else if(tune_memory[i].freq_bin > bin) {
+            if((hi == TUNE_MEM_ENTRIES) || (tune_memory[i].freq_bin < tune_memory[hi].freq_bin)) { hi = i; }
+        }
+    }
+    if((lo == TUNE_MEM_ENTRIES) || (hi == TUNE_MEM_ENTRIES)) { return 0; }
+    if(tune_memory[lo].net_side != tune_memory[hi].net_side) { return 0; } // Different networks, no smooth path
+    // Antenna bandwidth scales with frequency, so does the span a straight line holds over
+    if((uint32_t)(tune_memory[hi].freq_bin - tune_memory[lo].freq_bin) * TUNE_MEM_BIN_KHZ >
+       (freq >> TUNE_MEM_INTERP_SPAN_SHIFT)) { return 0; }
+
+    freq_lo = tune_memory_bin_center(tune_memory[lo].freq_bin);
+    freq_hi = tune_memory_bin_center(tune_memory[hi].freq_bin);
+
+    solution->ind_position = interpolate_position(freq, freq_lo, tune_memory[lo].ind_position,
+                                                  freq_hi, tune_memory[hi].ind_position);
+
+    cap_lo = (tune_memory[lo].relay_setting * C_RELAY_STEP) + tune_memory[lo].cap_position;
+    cap_hi = (tune_memory[hi].relay_setting * C_RELAY_STEP) + tune_memory[hi].cap_position;
+    cap = interpolate_position(freq, freq_lo, cap_lo, freq_hi, cap_hi);
+    solution->relay_setting = 0;
+    if(cap > C_VARICAP_MIN) { solution->relay_setting = (cap - C_VARICAP_MIN) / C_RELAY_STEP; }
+    if(solution->relay_setting > 7) { solution->relay_setting = 7; }
+    solution->cap_position = cap - (solution->relay_setting * C_RELAY_STEP);
+    if(solution->cap_position > C_UPPER_LIMIT) { solution->cap_position = C_UPPER_LIMIT; }
+
+    solution->net_side = tune_memory[lo].net_side;
+    solution->freq_bin = bin;
+    return 1;
+}
+
+
+// Save a converged solution for the given frequency. An existing entry for the
+// same bin is replaced, otherwise the first free entry is used. Once the table
+// is full, entries are recycled in round robin order.
+void tune_memory_store(uint32_t freq_hz, const tune_solution_t *solution)
+{
+    uint8_t i, index = TUNE_MEM_ENTRIES;
+    uint16_t bin, protection;
+    uint32_t freq = FREQ_HZ_TO_KHZ(freq_hz);
+
+    if(freq < TUNE_MEM_BIN_KHZ) { return; }
+    bin = tune_memory_bin(freq);
+
+    for(i = 0; i < TUNE_MEM_ENTRIES; i++)
+    {
+        if(tune_memory[i].freq_bin == bin) { index = i; break; }
+        if((index == TUNE_MEM_ENTRIES) && (tune_memory[i].freq_bin == TUNE_MEM_EMPTY)) { index = i; }
+    }
+
+    protection = fram_write_enable();
+    if(index == TUNE_MEM_ENTRIES)
+    {
+        index = tune_memory_next;
+        tune_memory_next = (tune_memory_next + 1) % TUNE_MEM_ENTRIES;
+    }
+    tune_memory[index] = *solution;
+    tune_memory[index].freq_bin = bin;
+    fram_write_restore(protection);
+}
+
+
+// Clear the stored solution for the given frequency, if there is one.
+void tune_memory_forget(uint32_t freq_hz)
+{
+    uint8_t i;
+    uint16_t bin, protection;
+    uint32_t freq = FREQ_HZ_TO_KHZ(freq_hz);
+
+    if(freq < TUNE_MEM_BIN_KHZ) { return; }
+    bin = tune_memory_bin(freq);
+
+    for(i = 0; i < TUNE_MEM_ENTRIES; i++)
+    {
+        if(tune_memory[i].freq_bin != bin) { continue; }
+        protection = fram_write_enable();
+        tune_memory[i].freq_bin = TUNE_MEM_EMPTY;
+        fram_write_restore(protection);
+        return;
+    }
+}
@@ -16,6 +16,12 @@ uint8_t display_menu= 1;
 uint8_t MODE_SWITCH = 0;
 uint8_t PREV_MODE = 0;
 uint8_t button_press = 0;
+volatile uint16_t timer3_overflows = 0; // Upper word of the Timer3 ACLK time base
+// Tune settings, kept in FRAM
+#pragma PERSISTENT(target_swr)
+uint8_t target_swr = TARGET_SWR_DEFAULT; // Tune stops once SWR is at or below this
+#pragma PERSISTENT(threshold_swr)
+uint8_t threshold_swr = THRESHOLD_SWR_OFF; // Tune starts when SWR rises above this
 // Broken down as follows:
 // BIT0  |  BIT1  |  BIT2  |  BIT3  |  BIT4  |  BIT5  |    BIT6  |  BIT7
 // TUNE     MODE     ANT     L-UP      C-UP     L-DN       C-DN    MODE_LOCK
@@ -31,6 +37,10 @@ void mode_3(void);
 void mode_21(void);
 void mode_22(void);
 void mode_23(void);
+void mode_24(void);
+void adjust_setting(int8_t direction);
+_iq16 swr_setting(uint8_t tenths);
+static void swr_setting_to_str(uint8_t tenths, char s[]);
 
 
 // Display variables and titles
@@ -44,6 +54,35 @@ static const char ind_unit[4] = {'u', 'H', ' ', '\0'};
 static const char target_mode_name[11] = "Target SWR\0";
 static const char threshold_mode_name[14] = "SWR Threshold\0";
 static const char lclimit_mode_name[9] = "LC Limit\0";
+static const char hysteresis_mode_name[16] = "Freq Hysteresis\0";
+
+// Formatted copies of the tune snapshot, rebuilt only when it changes
+static char cap2_val[8] = {'\0'};
+static char ind2_val[6] = {'\0'};
+static char swr_val[5] = {'\0'};
+static char load_imp[7] = {'\0'};
+static uint16_t formatted_seq = 0xFFFF;
+
+
+// Format the tune snapshot for display if it has changed since the last refresh.
+static void format_snapshot(void)
+{
+    uint8_t error = 0;
+
+    if(formatted_seq == tune_snapshot.seq) { return; }
+
+    memset(&cap2_val[0], 0, sizeof(cap2_val));
+    memset(&ind2_val[0], 0, sizeof(ind2_val));
+    memset(&swr_val[0], 0, sizeof(swr_val));
+    memset(&load_imp[0], 0, sizeof(load_imp));
+    if(tune_snapshot.vswr) { error += _IQ16toa(swr_val, "%2.1f", tune_snapshot.vswr); }
+    if(tune_snapshot.resistance) {
+        error += _IQ16toa(load_imp, "%3.2f", tune_snapshot.resistance);
+        error += _IQ16toa(cap2_val, "%4.2f", tune_snapshot.capacitance);
+        error += _IQ16toa(ind2_val, "%2.2f", tune_snapshot.inductance);
+    }
+    if(error == 0) { formatted_seq = tune_snapshot.seq; }
+}
 
 
 // TODO: User interface button configuration
@@ -109,6 +148,9 @@ void lcd_update(void)
     case LC_DISPLAY:
         mode_23();
         break;
+    case FREQ_HYSTERESIS:
+        mode_24();
+        break;
     }
 
 }
@@ -122,8 +164,9 @@ void mode_1(void)  // Default display w/ frequ.
     char row2[17] = {'\0'};
 
     uint8_t str_length = 0;
-    uint8_t freq_whole = frequency / 1000;
-    uint16_t freq_decimal = frequency % 1000;
+    uint32_t freq_khz = FREQ_HZ_TO_KHZ(frequency);
+    uint16_t freq_whole = freq_khz / 1000;
+    uint16_t freq_decimal = freq_khz % 1000;
     utoa(freq_whole, row1);
     utoa(freq_decimal, buf2);
 
@@ -160,6 +203,8 @@ void mode_2(void)  // Tuning display with impedance network
     char row1[17] = {'\0'};
     char row2[17] = {'\0'};
 
+    format_snapshot();
+
     strcat(row1, cap_disp);
     strcat(row2, ind_disp);
 
@@ -183,6 +228,7 @@ void mode_3(void)  // Tuning display with impedance network
     char row2[17] = {'\0'};
     char curr_ind[6] = {'\0'};
     char curr_cap[8] = {'\0'};
+    char tune_time[6] = {'\0'};
 
     uint8_t error = 0;
     uint16_t ind_range = L_UPPER_LIMIT - L_LOWER_LIMIT;
@@ -196,6 +242,9 @@ void mode_3(void)  // Tuning display with impedance network
     _iq19 current_capacitance = _IQ19mpy(_IQ19(cap_sample), cap_scale);
     error = _IQ19toa(curr_cap, "%4.2f", current_capacitance);
 
+    // Duration of the last tune in seconds
+    error = _IQ16toa(tune_time, "%2.1f", _IQ16div(_IQ16(tune_report.duration_ms / 100), _IQ16(10)));
+
     strcat(row1, cap_disp);
     strcat(row2, ind_disp);
 
@@ -205,8 +254,9 @@ void mode_3(void)  // Tuning display with impedance network
     strcat(row1, cap_unit);
     strcat(row2, ind_unit);
 
+    format_snapshot();
     strcat(row1, swr_val);
-    strcat(row2, "Menu2\0");
+    if(tune_count) { strcat(row2, tune_time); strcat(row2, "s\0"); }
 
     if(error) { asm("    NOP"); }
 
@@ -219,26 +269,30 @@ void mode_21(void) // Target SWR mode
 {
 
     char row1[17] = {'\0'};
-    // char row2[17] = {'\0'};
+    char row2[17] = {'\0'};
 
     strcat(row1, target_mode_name);
+    swr_setting_to_str(target_swr, row2);
 
     hd44780_write_string(row1, 1, 1, CR_LF );
     hd44780_blank_out_remaining_row(1,11);
+    hd44780_write_string(row2, 2, 1, CR_LF );
 
-    // Adjust target SWR from 1.5 to 2.0
+    // Adjust target SWR from 1.5 to 2.0 with the L/C up and down buttons
 }
 
 void mode_22(void)  // AutoTune Threshold SWR mode
 {
     char row1[17] = {'\0'};
-    // char row2[17] = {'\0'};
+    char row2[17] = {'\0'};
 
     strcat(row1, threshold_mode_name);
+    if(threshold_swr == THRESHOLD_SWR_OFF) { strcat(row2, "Off\0"); }
+    else { swr_setting_to_str(threshold_swr, row2); }
 
     hd44780_write_string(row1, 1, 1, CR_LF );
     hd44780_blank_out_remaining_row(1, 14);
-    hd44780_blank_out_remaining_row(2, 1);
+    hd44780_write_string(row2, 2, 1, CR_LF );
 
     // Threshold of SWR and tuning will begin when it is surpassed
 }
@@ -258,6 +312,76 @@ void mode_23(void) // LC Limit
     // Turns off limits for L and C -OR- Display max values instead
 }
 
+void mode_24(void) // Frequency hysteresis
+{
+    char row1[17] = {'\0'};
+    char row2[17] = {'\0'};
+    char buf[4] = {'\0'};
+
+    strcat(row1, hysteresis_mode_name);
+    utoa(freq_hysteresis, buf);
+    strcat(row2, buf);
+    strcat(row2, " kHz\0");
+
+    hd44780_write_string(row1, 1, 1, CR_LF );
+    hd44780_blank_out_remaining_row(1, 16);
+    hd44780_write_string(row2, 2, 1, CR_LF );
+
+    // Adjust the step in frequency taken as a change of band, 1 to 100 kHz
+}
+
+// Step the setting shown by the current menu up (direction > 0) or down. The
+// threshold never drops below the target, below that it switches auto tune off.
+// The frequency hysteresis steps by 1 kHz.
+void adjust_setting(int8_t direction)
+{
+    uint16_t protection;
+    uint8_t value;
+
+    protection = fram_write_enable();
+    if(display_menu == TARGET_SWR)
+    {
+        value = target_swr + direction;
+        if((value >= TARGET_SWR_MIN) && (value <= TARGET_SWR_MAX)) { target_swr = value; }
+        if((threshold_swr != THRESHOLD_SWR_OFF) && (threshold_swr < target_swr)) { threshold_swr = target_swr; }
+    }
+    else if(display_menu == AUTOTUNE_THRESH)
+    {
+        if(threshold_swr == THRESHOLD_SWR_OFF) { value = (direction > 0) ? target_swr : THRESHOLD_SWR_OFF; }
+        else if((threshold_swr == target_swr) && (direction < 0)) { value = THRESHOLD_SWR_OFF; }
+        else { value = threshold_swr + direction; }
+        if(value <= THRESHOLD_SWR_MAX) { threshold_swr = value; }
+    }
+    else if(display_menu == FREQ_HYSTERESIS)
+    {
+        if((direction > 0) && (freq_hysteresis < FREQ_HYSTERESIS_MAX)) { freq_hysteresis++; }
+        else if((direction < 0) && (freq_hysteresis > FREQ_HYSTERESIS_MIN)) { freq_hysteresis--; }
+    }
+    fram_write_restore(protection);
+}
+
+
+// Convert an SWR setting in tenths to an _iq16 ratio.
+_iq16 swr_setting(uint8_t tenths)
+{
+    return _IQ16div((_iq16)tenths << 16, _IQ16(10));
+}
+
+
+// Append an SWR setting in tenths to s as "SWR: x.y".
+static void swr_setting_to_str(uint8_t tenths, char s[])
+{
+    char buf[4] = {'\0'};
+
+    strcat(s, "SWR: \0");
+    utoa(tenths / 10, buf);
+    strcat(s, buf);
+    strcat(s, period);
+    utoa(tenths % 10, buf);
+    strcat(s, buf);
+}
+
+
 // utoa:  convert n to characters in s
 void utoa(unsigned int n, char s[])
 {
@@ -293,16 +417,19 @@ __interrupt void Timer3_B1( void )
     case TBIV_2: // CCR1 caused the interrupt
       TB3CCR1 += 64; // Add CCR1 value for next interrupt in 1 ms
       task_flag |= A_TASK;
+      __bic_SR_register_on_exit(LPM0_bits); // Wake the task loop
       break; // CCR1 interrupt handling done
 
     case TBIV_4: // CCR2 caused the interrupt
       TB3CCR2 += 328; // Add CCR2 value for next interrupt in 5 ms
       task_flag |= B_TASK;
+      __bic_SR_register_on_exit(LPM0_bits);
       break; // CCR2 interrupt handling done
 
     case TBIV_6: // CCR3 caused the interrupt
       TB3CCR3 += 3277; // Add CCR3 value for next interrupt in 50 ms
       task_flag |= C_TASK;
+      __bic_SR_register_on_exit(LPM0_bits);
       break; // CCR3 interrupt handling done
       
     case TBIV_8: // CCR4 caused the interrupt
@@ -313,10 +440,7 @@ __interrupt void Timer3_B1( void )
       break;
 
     case TBIV_10: // CCR5 caused the interrupt
-      TB1CTL = MC_0;
-      total_pulses = ((uint32_t)overflowCount << 16) | TB1R;
-      frequency = ((total_pulses << 4)) / 1000;
-      TB3CCTL5 = CCIE_0; // Compare interrupt disable
+      freq_gate_timeout(); // Frequency counter gate did not close
       break;
 
     case TBIV_12: // CCR6 caused the interrupt
@@ -325,6 +449,7 @@ __interrupt void Timer3_B1( void )
       break;
 
     case TBIV_14: // timer overflow caused the interrupt
+      timer3_overflows++;
       if(P1OUT & BIT0) P1OUT &= ~BIT0;
       else P1OUT |= BIT0;
       break;